@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nvvk/commands_vk.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Compute pipeline that knows its own workgroup size.
+// - The size is reflected from the SPIR-V module (LocalSize execution mode, overridden by a WorkgroupSize
+//   constant), so the host never repeats a shader's local_size
+// - dispatch_for_extent() launches the fewest workgroups covering an extent, the shaders still drop the
+//   threads of the last partial workgroup
+// - Debug builds check every dispatch against the device's workgroup count limits, indirect ones through
+//   the most workgroups the GPU can ever ask for, when the pipeline is created
+//
+class Compute_Pipeline {
+public:
+  VkPipeline       pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout layout   = VK_NULL_HANDLE;
+  uint32_t         local_size[3]{1, 1, 1};
+  uint32_t         max_group_count[3]{UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+  // Reads the workgroup size out of a SPIR-V module, false when the module has none
+  bool reflect_local_size(const std::string& code) {
+    const size_t word_count = code.size() / sizeof(uint32_t);
+    if(word_count < 5) {
+      return false;
+    }
+    std::vector<uint32_t> words(word_count);
+    memcpy(words.data(), code.data(), word_count * sizeof(uint32_t));
+    if(words[0] != SPIRV_MAGIC) {
+      return false;
+    }
+
+    bool                                   found = false;
+    uint32_t                               workgroup_size_id = 0;
+    std::unordered_map<uint32_t, uint32_t> constants;       // Result id -> 32 bit scalar value
+    std::unordered_map<uint32_t, size_t>   composites;      // Result id -> word of its first constituent
+    for(size_t word = 5; word < word_count;) {
+      const uint32_t opcode = words[word] & 0xFFFFu;
+      const uint32_t length = words[word] >> 16;
+      if(length == 0 || word + length > word_count) {
+        break;
+      }
+
+      if(opcode == OP_EXECUTION_MODE && length >= 6 && words[word + 2] == EXECUTION_MODE_LOCAL_SIZE) {
+        local_size[0] = words[word + 3];
+        local_size[1] = words[word + 4];
+        local_size[2] = words[word + 5];
+        found         = true;
+      }
+      else if(opcode == OP_DECORATE && length >= 4 && words[word + 2] == DECORATION_BUILT_IN && words[word + 3] == BUILT_IN_WORKGROUP_SIZE) {
+        workgroup_size_id = words[word + 1];
+      }
+      else if((opcode == OP_CONSTANT || opcode == OP_SPEC_CONSTANT) && length == 4) {
+        constants[words[word + 2]] = words[word + 3];
+      }
+      else if((opcode == OP_CONSTANT_COMPOSITE || opcode == OP_SPEC_CONSTANT_COMPOSITE) && length == 6) {
+        composites[words[word + 2]] = word + 3;
+      }
+      word += length;
+    }
+
+    // A WorkgroupSize constant takes precedence over the execution mode
+    auto composite = composites.find(workgroup_size_id);
+    if(workgroup_size_id != 0 && composite != composites.end()) {
+      for(uint32_t axis = 0; axis < 3; ++axis) {
+        auto constant = constants.find(words[composite->second + axis]);
+        if(constant != constants.end()) {
+          local_size[axis] = constant->second;
+        }
+      }
+      found = true;
+    }
+    return found;
+  }
+
+  // Workgroups along each axis covering `extent` threads
+  uint32_t group_count(uint32_t extent, uint32_t axis) const { return (extent + local_size[axis] - 1) / local_size[axis]; }
+
+  void dispatch_for_extent(VkCommandBuffer cmdBuf, uint32_t width, uint32_t height = 1, uint32_t depth = 1) const {
+    const uint32_t groups[3]{group_count(width, 0), group_count(height, 1), group_count(depth, 2)};
+#ifndef NDEBUG
+    for(uint32_t axis = 0; axis < 3; ++axis) {
+      assert(groups[axis] <= max_group_count[axis] && "Dispatch exceeds maxComputeWorkGroupCount");
+    }
+#endif
+    if(groups[0] == 0 || groups[1] == 0 || groups[2] == 0) {
+      return;
+    }
+    vkCmdDispatch(cmdBuf, groups[0], groups[1], groups[2]);
+  }
+
+  // Indirect arguments are written on the GPU along x only, `max_groups` is the most they can hold
+  void check_indirect_groups(uint32_t max_groups) const {
+    assert(max_groups <= max_group_count[0] && "Indirect dispatch can exceed maxComputeWorkGroupCount");
+    (void)max_groups;
+  }
+
+  void destroy(VkDevice device) {
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, layout, nullptr);
+    pipeline = VK_NULL_HANDLE;
+    layout   = VK_NULL_HANDLE;
+  }
+
+private:
+  static constexpr uint32_t SPIRV_MAGIC                    = 0x07230203u;
+  static constexpr uint32_t OP_EXECUTION_MODE              = 16;
+  static constexpr uint32_t OP_CONSTANT                    = 43;
+  static constexpr uint32_t OP_CONSTANT_COMPOSITE          = 44;
+  static constexpr uint32_t OP_SPEC_CONSTANT               = 50;
+  static constexpr uint32_t OP_SPEC_CONSTANT_COMPOSITE     = 51;
+  static constexpr uint32_t OP_DECORATE                    = 71;
+  static constexpr uint32_t EXECUTION_MODE_LOCAL_SIZE      = 17;
+  static constexpr uint32_t DECORATION_BUILT_IN            = 11;
+  static constexpr uint32_t BUILT_IN_WORKGROUP_SIZE        = 25;
+};
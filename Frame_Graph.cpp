@@ -0,0 +1,362 @@
+#include <chrono>
+
+#include "Frame_Graph.h"
+
+
+static const VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                                               | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+                                               | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+
+//--------------------------------------------------------------------------------------------------
+// Resources are looked up by name so their state persists from one frame to the next.
+// A new handle under the same name (e.g. after a resize) starts from a clean state.
+//
+uint32_t Frame_Graph::import_resource(const std::string& name, VkImage image, VkBuffer buffer, bool persistent, VkImageAspectFlags aspect) {
+  for(uint32_t i = 0; i < static_cast<uint32_t>(resources.size()); ++i) {
+    Resource& resource = resources[i];
+    if(resource.name != name) {
+      continue;
+    }
+
+    if(resource.image != image || resource.buffer != buffer) {
+      resource = Resource{};
+      resource.name = name;
+    }
+    resource.image      = image;
+    resource.buffer     = buffer;
+    resource.aspect     = aspect;
+    resource.persistent = persistent;
+    return i;
+  }
+
+  Resource resource;
+  resource.name       = name;
+  resource.image      = image;
+  resource.buffer     = buffer;
+  resource.aspect     = aspect;
+  resource.persistent = persistent;
+  resources.push_back(resource);
+  return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t Frame_Graph::import_image(const std::string& name, VkImage image, bool persistent, VkImageAspectFlags aspect) {
+  return import_resource(name, image, VK_NULL_HANDLE, persistent, aspect);
+}
+
+uint32_t Frame_Graph::import_buffer(const std::string& name, VkBuffer buffer, bool persistent) {
+  return import_resource(name, VK_NULL_HANDLE, buffer, persistent, 0);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Passes are declared in their logical order, which is the order used for any conflicting access
+//
+void Frame_Graph::add_pass(const std::string& name, std::vector<Access> reads, std::vector<Access> writes, Execute execute,
+                           bool side_effects, Queue queue) {
+  Pass pass;
+  pass.name         = name;
+  pass.reads        = std::move(reads);
+  pass.writes       = std::move(writes);
+  pass.execute      = std::move(execute);
+  pass.side_effects = side_effects;
+  pass.queue        = queue;
+  passes.push_back(std::move(pass));
+  compiled = false;
+}
+
+void Frame_Graph::begin_frame() {
+  passes.clear();
+  order.clear();
+  compiled = false;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Two passes have to keep their declared order when one writes something the other touches
+//
+bool Frame_Graph::depends_on(const Pass& later, const Pass& earlier) const {
+  if(later.side_effects && earlier.side_effects) {
+    return true;
+  }
+
+  for(const Access& write : earlier.writes) {
+    for(const Access& read : later.reads) {
+      if(read.resource == write.resource) {
+        return true;
+      }
+    }
+    for(const Access& other : later.writes) {
+      if(other.resource == write.resource) {
+        return true;
+      }
+    }
+  }
+
+  for(const Access& read : earlier.reads) {
+    for(const Access& write : later.writes) {
+      if(write.resource == read.resource) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Culling walks the passes backwards from the roots (side effects and persistent resources).
+// Scheduling then greedily picks, among the passes whose dependencies are done, the first one that
+// does not depend on the pass just scheduled, so independent work lands between dependent passes.
+//
+void Frame_Graph::compile() {
+  const size_t pass_count = passes.size();
+
+  std::vector<bool> live(pass_count, false);
+  std::vector<bool> needed(resources.size(), false);
+  for(size_t i = pass_count; i-- > 0;) {
+    const Pass& pass = passes[i];
+
+    bool keep = pass.side_effects;
+    for(const Access& write : pass.writes) {
+      keep = keep || needed[write.resource] || resources[write.resource].persistent;
+    }
+    if(!keep) {
+      continue;
+    }
+
+    live[i] = true;
+    for(const Access& write : pass.writes) {
+      needed[write.resource] = false;
+    }
+    for(const Access& read : pass.reads) {
+      needed[read.resource] = true;
+    }
+  }
+
+  std::vector<uint32_t> remaining;
+  for(uint32_t i = 0; i < static_cast<uint32_t>(pass_count); ++i) {
+    if(live[i]) {
+      remaining.push_back(i);
+    }
+  }
+
+  order.clear();
+  int last = -1;
+  while(!remaining.empty()) {
+    size_t pick             = remaining.size();
+    bool   pick_independent = false;
+
+    for(size_t k = 0; k < remaining.size(); ++k) {
+      const Pass& candidate = passes[remaining[k]];
+
+      bool ready = true;
+      for(size_t j = 0; j < k && ready; ++j) {
+        ready = !depends_on(candidate, passes[remaining[j]]);
+      }
+      if(!ready) {
+        continue;
+      }
+
+      const bool independent = last < 0 || !depends_on(candidate, passes[last]);
+      if(pick == remaining.size() || (independent && !pick_independent)) {
+        pick             = k;
+        pick_independent = independent;
+      }
+      if(pick_independent) {
+        break;
+      }
+    }
+
+    last = static_cast<int>(remaining[pick]);
+    order.push_back(remaining[pick]);
+    remaining.erase(remaining.begin() + pick);
+  }
+
+  // Batches: a graphics pass goes before the async ones when any of them (transitively) depends on it
+  async_passes = false;
+  for(size_t k = order.size(); k-- > 0;) {
+    Pass& pass = passes[order[k]];
+    if(pass.queue == QUEUE_ASYNC_COMPUTE) {
+      pass.batch   = BATCH_ASYNC;
+      async_passes = true;
+      continue;
+    }
+
+    pass.batch = BATCH_AFTER_ASYNC;
+    for(size_t j = k + 1; j < order.size(); ++j) {
+      const Pass& later = passes[order[j]];
+      if(later.batch != BATCH_AFTER_ASYNC && depends_on(later, pass)) {
+        pass.batch = BATCH_BEFORE_ASYNC;
+        break;
+      }
+    }
+  }
+  if(!async_passes) {
+    for(uint32_t index : order) {
+      passes[index].batch = BATCH_ALL;
+    }
+  }
+
+  schedule_info.clear();
+  for(uint32_t index : order) {
+    Pass_Info info;
+    info.name  = passes[index].name;
+    info.batch = passes[index].batch;
+    schedule_info.push_back(info);
+  }
+  for(uint32_t i = 0; i < static_cast<uint32_t>(pass_count); ++i) {
+    if(!live[i]) {
+      Pass_Info info;
+      info.name   = passes[i].name;
+      info.culled = true;
+      schedule_info.push_back(info);
+    }
+  }
+
+  compiled = true;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Barriers against the tracked state of every resource the pass touches:
+// - writes (and layout changes) wait for the previous writer and for every reader since
+// - reads only wait when the last write has not been made visible to their stage yet
+//
+uint32_t Frame_Graph::record_barriers(const Pass& pass, Gpu_Barriers& barriers) {
+  struct Use {
+    uint32_t             resource;
+    VkPipelineStageFlags stage  = 0;
+    VkAccessFlags        access = 0;
+    VkImageLayout        layout = VK_IMAGE_LAYOUT_GENERAL;
+    bool                 write  = false;
+  };
+
+  // Merge read-modify-write accesses into a single use per resource
+  std::vector<Use> uses;
+  auto             merge = [&](const Access& access, bool write) {
+    for(Use& use : uses) {
+      if(use.resource == access.resource) {
+        use.stage |= access.stage;
+        use.access |= access.access;
+        use.write = use.write || write;
+        return;
+      }
+    }
+    Use use;
+    use.resource = access.resource;
+    use.stage    = access.stage;
+    use.access   = access.access;
+    use.layout   = access.layout;
+    use.write    = write;
+    uses.push_back(use);
+  };
+  for(const Access& read : pass.reads) {
+    merge(read, false);
+  }
+  for(const Access& write : pass.writes) {
+    merge(write, true);
+  }
+
+  uint32_t barrier_count = 0;
+  for(const Use& use : uses) {
+    Resource& resource = resources[use.resource];
+
+    // Last touched on the other queue: the semaphore between the two batches made every write available
+    // and waited at queue_handoff_stage, so only later stages still need a dependency
+    if(resource.queue != pass.queue) {
+      if(resource.write_stage != 0 || resource.read_stages != 0) {
+        resource.write_stage    = queue_handoff_stage;
+        resource.write_access   = 0;
+        resource.read_stages    = 0;
+        resource.visible_stages = queue_handoff_stage;
+        resource.visible_access = ~VkAccessFlags(0);
+        resource.handoff        = true;
+      }
+      resource.queue = pass.queue;
+    }
+
+    const bool layout_change = resource.image != VK_NULL_HANDLE && resource.layout != use.layout;
+    bool       needs_barrier = false;
+    VkPipelineStageFlags src_stage  = 0;
+    VkAccessFlags        src_access = 0;
+
+    if(use.write || layout_change) {
+      src_stage     = resource.write_stage | resource.read_stages;
+      src_access    = resource.write_access;
+      needs_barrier = src_stage != 0 || layout_change;
+      if(resource.handoff && !layout_change && (use.stage & ~queue_handoff_stage) == 0) {
+        needs_barrier = false;
+      }
+    } else if(resource.write_stage != 0) {
+      const bool visible = (resource.visible_stages & use.stage) == use.stage && (resource.visible_access & use.access) == use.access;
+      src_stage     = resource.write_stage;
+      src_access    = resource.write_access;
+      needs_barrier = !visible;
+    }
+
+    if(needs_barrier) {
+      if(src_stage == 0) {
+        src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      }
+      if(resource.image != VK_NULL_HANDLE) {
+        barriers.image(resource.image, src_stage, src_access, use.stage, use.access, resource.layout, use.layout, resource.aspect);
+      } else {
+        barriers.buffer(resource.buffer, src_stage, src_access, use.stage, use.access);
+      }
+      ++barrier_count;
+    }
+
+    // Update the tracked state. A write (read-modify-write included) is visible to nobody yet, so every
+    // later read waits on it; a layout change alone leaves the previous write visible to this use.
+    if(use.write || layout_change) {
+      resource.write_stage    = use.stage;
+      resource.write_access   = use.access & WRITE_ACCESS_MASK;
+      resource.read_stages    = use.write ? 0 : use.stage;
+      resource.visible_stages = use.write ? 0 : use.stage;
+      resource.visible_access = use.write ? 0 : use.access;
+      resource.layout         = use.layout;
+      resource.handoff        = false;
+    } else {
+      resource.read_stages |= use.stage;
+      resource.visible_stages |= use.stage;
+      resource.visible_access |= use.access;
+    }
+  }
+
+  return barrier_count;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Records the passes of one batch; with async passes each batch goes into its own command buffer
+//
+void Frame_Graph::execute(VkCommandBuffer cmdBuf, Batch batch) {
+  if(!compiled) {
+    compile();
+  }
+
+  Gpu_Barriers barriers;
+  for(size_t k = 0; k < order.size(); ++k) {
+    const Pass& pass = passes[order[k]];
+    if(batch != BATCH_ALL && pass.batch != batch) {
+      continue;
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    schedule_info[k].barrier_count = record_barriers(pass, barriers);
+    barriers.flush(cmdBuf);
+
+    if(on_pass_begin) {
+      on_pass_begin(cmdBuf, pass.name);
+    }
+    pass.execute(cmdBuf);
+    if(on_pass_end) {
+      on_pass_end(cmdBuf, pass.name);
+    }
+
+    schedule_info[k].cpu_time_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Gpu_Barriers.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Declarative frame graph
+// - Resources are imported by name every frame; their synchronization state survives between frames,
+//   so hazards against the previous frame (e.g. post reading what sampling overwrites) are covered too
+// - Passes declare the resources they read and write with the stage/access/layout they use
+// - compile() culls passes whose results nobody consumes and reorders independent passes
+// - execute() records the minimal barriers in front of each pass and then the pass itself
+// - Passes can be tagged for an async compute queue; the frame is then split into three batches
+//   (graphics work the async passes wait on, the async passes, the remaining graphics work),
+//   submitted separately and chained with semaphores
+//
+class Frame_Graph {
+public:
+  using Execute   = std::function<void(VkCommandBuffer)>;
+  using Pass_Hook = std::function<void(VkCommandBuffer, const std::string&)>;
+
+  enum Queue : uint32_t {
+    QUEUE_GRAPHICS = 0,
+    QUEUE_ASYNC_COMPUTE,
+  };
+
+  enum Batch : uint32_t {
+    BATCH_ALL = 0,      // Everything, single queue
+    BATCH_BEFORE_ASYNC, // Graphics passes the async passes depend on
+    BATCH_ASYNC,        // Async compute passes
+    BATCH_AFTER_ASYNC,  // Remaining graphics passes
+  };
+
+  struct Access {
+    uint32_t             resource;
+    VkPipelineStageFlags stage;
+    VkAccessFlags        access;
+    VkImageLayout        layout = VK_IMAGE_LAYOUT_GENERAL;  // Ignored for buffers
+  };
+
+  struct Pass_Info {
+    std::string name;
+    bool        culled        = false;
+    uint32_t    barrier_count = 0;      // Image and buffer barriers recorded in front of the pass
+    float       cpu_time_ms   = 0.0f;   // Time spent recording the pass
+    Batch       batch         = BATCH_ALL;
+  };
+
+  // Resources
+  // `persistent` resources carry history to the next frame, so their writers are never culled
+  uint32_t import_image(const std::string& name, VkImage image, bool persistent = false, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+  uint32_t import_buffer(const std::string& name, VkBuffer buffer, bool persistent = false);
+
+  // Passes
+  // Passes with side effects (e.g. writing the swapchain) are the roots of the graph
+  void add_pass(const std::string& name, std::vector<Access> reads, std::vector<Access> writes, Execute execute,
+                bool side_effects = false, Queue queue = QUEUE_GRAPHICS);
+
+  void begin_frame();
+  void compile();
+  void execute(VkCommandBuffer cmdBuf, Batch batch = BATCH_ALL);
+
+  // True when the compiled frame has to be submitted as three batches
+  bool has_async_passes() const { return async_passes; }
+
+  // Stage at which each batch waits on the semaphore of the other queue.
+  // Resources crossing queues only need a dependency for the stages past this one.
+  VkPipelineStageFlags queue_handoff_stage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+  // Optional callbacks wrapped around every executed pass (debug labels, profiling)
+  Pass_Hook on_pass_begin;
+  Pass_Hook on_pass_end;
+
+  // Execution order of the last compiled frame, culled passes last
+  const std::vector<Pass_Info>& get_schedule() const { return schedule_info; }
+
+private:
+  struct Resource {
+    std::string        name;
+    VkImage            image  = VK_NULL_HANDLE;
+    VkBuffer           buffer = VK_NULL_HANDLE;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    bool               persistent = false;
+
+    // Synchronization state, carried over between frames
+    VkPipelineStageFlags write_stage    = 0;
+    VkAccessFlags        write_access   = 0;
+    VkPipelineStageFlags read_stages    = 0;  // Readers since the last write
+    VkPipelineStageFlags visible_stages = 0;  // Stages the last write was already made visible to
+    VkAccessFlags        visible_access = 0;
+    VkImageLayout        layout         = VK_IMAGE_LAYOUT_GENERAL;
+    Queue                queue          = QUEUE_GRAPHICS;  // Queue of the last access
+    bool                 handoff        = false;           // Synchronized by a semaphore since the last write
+  };
+
+  struct Pass {
+    std::string         name;
+    std::vector<Access> reads;
+    std::vector<Access> writes;
+    Execute             execute;
+    bool                side_effects = false;
+    Queue               queue        = QUEUE_GRAPHICS;
+    Batch               batch        = BATCH_ALL;
+  };
+
+  uint32_t import_resource(const std::string& name, VkImage image, VkBuffer buffer, bool persistent, VkImageAspectFlags aspect);
+  bool     depends_on(const Pass& later, const Pass& earlier) const;
+  uint32_t record_barriers(const Pass& pass, Gpu_Barriers& barriers);
+
+  std::vector<Resource>  resources;
+  std::vector<Pass>      passes;
+  std::vector<uint32_t>  order;  // Indices into `passes` of the surviving passes, in execution order
+  std::vector<Pass_Info> schedule_info;
+  bool                   compiled     = false;
+  bool                   async_passes = false;
+};
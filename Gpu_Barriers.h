@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "nvvk/commands_vk.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Stage/access scoped barriers recorded straight into the frame command buffer.
+// - Barriers are collected and flushed as a single vkCmdPipelineBarrier
+// - All the GI images live in VK_IMAGE_LAYOUT_GENERAL, so most barriers only carry a memory dependency
+// - A source access of 0 expresses a pure execution dependency (write-after-read)
+//
+class Gpu_Barriers {
+public:
+  void image(VkImage              image,
+             VkPipelineStageFlags src_stage,
+             VkAccessFlags        src_access,
+             VkPipelineStageFlags dst_stage,
+             VkAccessFlags        dst_access,
+             VkImageLayout        old_layout = VK_IMAGE_LAYOUT_GENERAL,
+             VkImageLayout        new_layout = VK_IMAGE_LAYOUT_GENERAL,
+             VkImageAspectFlags   aspect     = VK_IMAGE_ASPECT_COLOR_BIT) {
+    VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask       = src_access;
+    barrier.dstAccessMask       = dst_access;
+    barrier.oldLayout           = old_layout;
+    barrier.newLayout           = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = image;
+    barrier.subresourceRange    = {aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+    image_barriers.push_back(barrier);
+    src_stages |= src_stage;
+    dst_stages |= dst_stage;
+  }
+
+  void buffer(VkBuffer             buffer,
+              VkPipelineStageFlags src_stage,
+              VkAccessFlags        src_access,
+              VkPipelineStageFlags dst_stage,
+              VkAccessFlags        dst_access,
+              VkDeviceSize         offset = 0,
+              VkDeviceSize         size   = VK_WHOLE_SIZE) {
+    VkBufferMemoryBarrier barrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    barrier.srcAccessMask       = src_access;
+    barrier.dstAccessMask       = dst_access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer              = buffer;
+    barrier.offset              = offset;
+    barrier.size                = size;
+
+    buffer_barriers.push_back(barrier);
+    src_stages |= src_stage;
+    dst_stages |= dst_stage;
+  }
+
+  bool empty() const { return image_barriers.empty() && buffer_barriers.empty(); }
+
+  // Record every pending barrier with one vkCmdPipelineBarrier
+  void flush(VkCommandBuffer cmdBuf) {
+    if(empty()) {
+      return;
+    }
+
+    vkCmdPipelineBarrier(cmdBuf, src_stages, dst_stages, 0, 0, nullptr, static_cast<uint32_t>(buffer_barriers.size()),
+                         buffer_barriers.data(), static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+
+    image_barriers.clear();
+    buffer_barriers.clear();
+    src_stages = 0;
+    dst_stages = 0;
+  }
+
+private:
+  VkPipelineStageFlags               src_stages = 0;
+  VkPipelineStageFlags               dst_stages = 0;
+  std::vector<VkImageMemoryBarrier>  image_barriers;
+  std::vector<VkBufferMemoryBarrier> buffer_barriers;
+};
@@ -12,6 +12,15 @@
 #include "nvvk/raytraceKHR_vk.hpp"
 
 
+// One probe volume, ProbeVolume in probeUtil.glsl
+struct alignas(16) Probe_volume_gpu_constants {
+  glm::vec4  origin;        // World position of grid index 0
+  glm::vec4  spacing;       // Probe spacing, size of the debug spheres relative to the main grid in w
+  glm::ivec4 counts;        // Probe counts, index of the first probe in w
+  glm::ivec4 scroll;        // Storage slot of grid index 0, first atlas layer in w
+  glm::ivec4 scroll_delta;  // Cells scrolled this frame, most rays of a probe in w
+};
+
 struct alignas(16) Indirect_gpu_constants {
   uint32_t radiance_output_index;
   uint32_t grid_irradiance_output_index;
@@ -26,8 +35,8 @@ struct alignas(16) Indirect_gpu_constants {
   float   hysteresis;
   float   infinte_bounces_multiplier;
   
-  int32_t probe_update_offset;
-  int32_t probe_update_count;
+  int32_t probe_age_horizon;   // Frames after which a skipped probe is forced into the update list
+  int32_t probe_update_count;  // Per frame update budget
 
   glm::vec3 probe_grid_position;
   float     probe_sphere_scale;
@@ -44,15 +53,29 @@ struct alignas(16) Indirect_gpu_constants {
   int32_t irradiance_texture_width;
   int32_t irradiance_texture_height;
   int32_t irradiance_side_length;
-  int32_t probe_rays;
+  int32_t probe_rays;  // Max rays per probe, width of the radiance texture
 
   int32_t  visibility_texture_width;
   int32_t  visibility_texture_height;
   int32_t  visibility_side_length;
-  uint32_t pad1;
+  int32_t  probe_min_rays;  // Rays of a converged or dim probe
 
   glm::mat4 random_rotation;
   glm::vec2 resolution;
+  uint32_t  probe_sh_index;  // Storage image holding the SH irradiance of every probe
+  int32_t   probe_volume_count;
+
+  Probe_volume_gpu_constants probe_volumes[PROBE_MAX_VOLUMES];  // Extra volumes, then the cascades of the main grid
+
+  uint32_t indirect_low_res_index;  // Storage image of the reduced resolution irradiance, before the upsample
+
+  // Temporal accumulation, the history and guide images are swapped every frame
+  uint32_t motion_texture_index;           // G-buffer motion vectors, current minus previous screen uv
+  uint32_t indirect_history_index;         // Irradiance accumulated up to the previous frame, history length in alpha
+  uint32_t indirect_history_output_index;  // Irradiance accumulated up to this frame
+  uint32_t indirect_guide_index;           // Octahedral normal and view depth the previous history was accumulated at
+  uint32_t indirect_guide_output_index;
+  float    temporal_max_history;           // Frames the accumulation averages at most
 };  // struct DDGIConstants
 
 
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <fstream>
+
+#include "Gpu_Profiler.h"
+
+
+static const uint32_t NO_SCOPE = ~0u;
+
+
+void Gpu_Profiler::init(VkDevice device_, VkPhysicalDevice physical_device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t max_scopes_) {
+  device     = device_;
+  max_scopes = max_scopes_;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  timestamp_period = properties.limits.timestampPeriod;
+
+  // timestampValidBits is 0 without support, otherwise between 36 and 64
+  uint32_t family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+  family_masks.resize(family_count);
+  for(uint32_t i = 0; i < family_count; ++i) {
+    const uint32_t bits = families[i].timestampValidBits;
+    family_masks[i]     = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+  }
+  set_queue_family(queue_family);
+
+  VkQueryPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  pool_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = max_scopes * 2;
+
+  frames.resize(frames_in_flight);
+  for(Frame& frame : frames) {
+    vkCreateQueryPool(device, &pool_info, nullptr, &frame.pool);
+    vkResetQueryPool(device, frame.pool, 0, pool_info.queryCount);
+  }
+}
+
+void Gpu_Profiler::set_queue_family(uint32_t queue_family) {
+  timestamp_mask = queue_family < family_masks.size() ? family_masks[queue_family] : 0;
+}
+
+void Gpu_Profiler::destroy() {
+  for(Frame& frame : frames) {
+    vkDestroyQueryPool(device, frame.pool, nullptr);
+  }
+  frames.clear();
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// The frame fence guarantees every query of this slot was submitted and executed,
+// the availability check only guards scopes whose command buffer was never submitted
+//
+void Gpu_Profiler::begin_frame(uint32_t frame) {
+  current = frame;
+  open_scopes.clear();
+
+  Frame& slot = frames[current];
+  if(!slot.scope_names.empty()) {
+    const uint32_t        query_count = static_cast<uint32_t>(slot.scope_names.size()) * 2;
+    std::vector<uint64_t> results(query_count * 2);  // Value and availability per query
+    vkGetQueryPoolResults(device, slot.pool, 0, query_count, results.size() * sizeof(uint64_t), results.data(),
+                          2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    for(size_t i = 0; i < slot.scope_names.size(); ++i) {
+      // Only the valid bits are defined; the masked difference stays right across one wrap
+      const uint64_t mask            = slot.scope_masks[i];
+      const uint64_t begin           = results[i * 4 + 0] & mask;
+      const uint64_t begin_available = results[i * 4 + 1];
+      const uint64_t end             = results[i * 4 + 2] & mask;
+      const uint64_t end_available   = results[i * 4 + 3];
+      if(begin_available && end_available) {
+        add_sample(slot.scope_names[i], static_cast<float>(((end - begin) & mask) * timestamp_period * 1e-6));
+      }
+    }
+
+    vkResetQueryPool(device, slot.pool, 0, query_count);
+    slot.scope_names.clear();
+    slot.scope_masks.clear();
+  }
+}
+
+
+void Gpu_Profiler::begin_scope(VkCommandBuffer cmdBuf, const std::string& name) {
+  Frame& slot = frames[current];
+  if(timestamp_mask == 0) {
+    find_scope(name).no_timestamps = true;
+    open_scopes.push_back(NO_SCOPE);
+    return;
+  }
+  if(slot.scope_names.size() >= max_scopes) {
+    open_scopes.push_back(NO_SCOPE);
+    return;
+  }
+
+  const uint32_t index = static_cast<uint32_t>(slot.scope_names.size());
+  slot.scope_names.push_back(name);
+  slot.scope_masks.push_back(timestamp_mask);
+  open_scopes.push_back(index);
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool, index * 2);
+}
+
+void Gpu_Profiler::end_scope(VkCommandBuffer cmdBuf) {
+  if(open_scopes.empty()) {
+    return;
+  }
+
+  const uint32_t index = open_scopes.back();
+  open_scopes.pop_back();
+  if(index != NO_SCOPE) {
+    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames[current].pool, index * 2 + 1);
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Rolling statistics, scopes are listed in the order they first appeared
+//
+Gpu_Profiler::Scope_Stats& Gpu_Profiler::find_scope(const std::string& name) {
+  auto it = std::find_if(stats.begin(), stats.end(), [&](const Scope_Stats& scope) { return scope.name == name; });
+  if(it == stats.end()) {
+    Scope_Stats scope;
+    scope.name = name;
+    stats.push_back(scope);
+    it = stats.end() - 1;
+  }
+  return *it;
+}
+
+void Gpu_Profiler::add_sample(const std::string& name, float ms) {
+  Scope_Stats& scope = find_scope(name);
+  if(scope.history.size() < HISTORY_SIZE) {
+    scope.history.push_back(ms);
+  } else {
+    scope.history[scope.next] = ms;
+  }
+  scope.next = (scope.next + 1) % HISTORY_SIZE;
+
+  float sum    = 0.0f;
+  scope.min_ms = scope.history[0];
+  scope.max_ms = scope.history[0];
+  for(float sample : scope.history) {
+    sum += sample;
+    scope.min_ms = std::min(scope.min_ms, sample);
+    scope.max_ms = std::max(scope.max_ms, sample);
+  }
+  scope.avg_ms  = sum / static_cast<float>(scope.history.size());
+  scope.last_ms = ms;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Export
+//
+bool Gpu_Profiler::export_csv(const std::string& filename) const {
+  std::ofstream file(filename);
+  if(!file) {
+    return false;
+  }
+
+  file << "scope,last_ms,avg_ms,min_ms,max_ms,samples,no_timestamps\n";
+  for(const Scope_Stats& scope : stats) {
+    file << '"' << scope.name << "\"," << scope.last_ms << ',' << scope.avg_ms << ',' << scope.min_ms << ','
+         << scope.max_ms << ',' << scope.history.size() << ',' << (scope.no_timestamps ? 1 : 0) << '\n';
+  }
+  return true;
+}
+
+bool Gpu_Profiler::export_json(const std::string& filename) const {
+  std::ofstream file(filename);
+  if(!file) {
+    return false;
+  }
+
+  file << "{\n  \"scopes\": [\n";
+  for(size_t i = 0; i < stats.size(); ++i) {
+    const Scope_Stats& scope = stats[i];
+    file << "    {\"name\": \"" << scope.name << "\", \"last_ms\": " << scope.last_ms << ", \"avg_ms\": " << scope.avg_ms
+         << ", \"min_ms\": " << scope.min_ms << ", \"max_ms\": " << scope.max_ms << ", \"samples\": " << scope.history.size()
+         << ", \"no_timestamps\": " << (scope.no_timestamps ? "true" : "false")
+         << (i + 1 < stats.size() ? "},\n" : "}\n");
+  }
+  file << "  ]\n}\n";
+  return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "nvvk/commands_vk.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// GPU timestamp profiler
+// - One query pool per frame in flight; a frame's queries are read back when its slot comes around
+//   again, after the frame fence was waited on, so reading never stalls
+// - Results are fetched with the availability bit instead of VK_QUERY_RESULT_WAIT_BIT: a scope still
+//   in flight is skipped, never waited on
+// - Pools are reset from the host (hostQueryReset, core in Vulkan 1.2), so scopes can be recorded
+//   into any command buffer of the frame, on any queue
+// - Rolling average/min/max over the last `HISTORY_SIZE` samples of every scope
+// - Timestamps are masked to the valid bits of the queue family they were written on, so deltas
+//   survive a wrap; scopes on a family without timestamp support are skipped and flagged
+//
+class Gpu_Profiler {
+public:
+  static const uint32_t HISTORY_SIZE = 128;
+
+  struct Scope_Stats {
+    std::string name;
+    float       last_ms = 0.0f;
+    float       avg_ms  = 0.0f;
+    float       min_ms  = 0.0f;
+    float       max_ms  = 0.0f;
+
+    std::vector<float> history;  // Ring of the last samples
+    uint32_t           next = 0;
+
+    bool no_timestamps = false;  // Recorded on a queue family without timestamp support, never sampled
+  };
+
+  // `queue_family` is the family scopes are recorded on until set_queue_family() says otherwise
+  void init(VkDevice device, VkPhysicalDevice physical_device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t max_scopes = 64);
+  void destroy();
+
+  // Queue family of the command buffer the following scopes are recorded into
+  void set_queue_family(uint32_t queue_family);
+
+  // Collects the results of the last use of `frame` and resets its pool.
+  // Call once the fence of the frame was waited on, before recording any scope.
+  void begin_frame(uint32_t frame);
+
+  // Scopes can nest; a scope ends on the command buffer it began on
+  void begin_scope(VkCommandBuffer cmdBuf, const std::string& name);
+  void end_scope(VkCommandBuffer cmdBuf);
+
+  const std::vector<Scope_Stats>& get_stats() const { return stats; }
+
+  bool export_csv(const std::string& filename) const;
+  bool export_json(const std::string& filename) const;
+
+private:
+  struct Frame {
+    VkQueryPool              pool = VK_NULL_HANDLE;
+    std::vector<std::string> scope_names;  // Scope i uses queries 2i and 2i+1
+    std::vector<uint64_t>    scope_masks;  // Valid timestamp bits of the queue family each scope was written on
+  };
+
+  Scope_Stats& find_scope(const std::string& name);
+  void         add_sample(const std::string& name, float ms);
+
+  VkDevice                 device           = VK_NULL_HANDLE;
+  float                    timestamp_period = 1.0f;  // Nanoseconds per tick, from the device limits
+  uint32_t                 max_scopes       = 0;
+  uint32_t                 current          = 0;
+  uint64_t                 timestamp_mask   = 0;  // Of the current queue family
+  std::vector<uint64_t>    family_masks;          // Per queue family, 0 without timestamp support
+  std::vector<Frame>       frames;
+  std::vector<uint32_t>    open_scopes;
+  std::vector<Scope_Stats> stats;
+};
@@ -11,6 +11,14 @@
 // #VKRay
 #include "nvvk/raytraceKHR_vk.hpp"
 
+// An extra probe volume placed by hand, e.g. a dense grid for an interior next to the sparse main grid
+struct Probe_Grid_Settings {
+  glm::vec3  position{0.0f};  // World position of grid index 0
+  glm::vec3  spacing{1.0f};
+  glm::uvec3 counts{8};       // Read once at startup
+  int32_t    rays = PROBE_MAX_RAYS;  // Most rays a probe traces, read once at startup
+};
+
 struct renderSceneVolume {
   bool gi_show_probes = false;
 
@@ -49,10 +57,61 @@ struct renderSceneVolume {
   bool     gi_use_probe_offsetting        = true;
   bool     gi_recalculate_offsets         = false;  // When moving grid or changing spaces -> recalculate offsets
   bool     gi_use_probe_status            = false;
-  bool     gi_use_half_resolution         = true;
+  uint32_t gi_resolution_divider          = 2;  // Irradiance sampled at 1, 1/2 or 1/4 resolution, then upsampled bilaterally
+  bool     gi_use_sample_tiles            = true;  // Classify the sampling tiles first: skip the sky, share the probe cage of single cell tiles
+  bool     gi_use_temporal                = true;  // Accumulate the indirect lighting over frames, rotating the sampled pixel of each block
+  float    gi_temporal_max_history        = 16.0f;  // Frames the accumulation averages at most
   bool     gi_use_infinite_bounces        = false;
   float    gi_infinite_bounces_multiplier = 0.75f;
+  bool     gi_use_surface_cache           = true;  // Probe ray hits read the per triangle surface cache instead of the vertices, material and texture
   uint32_t gi_per_frame_probes_update     = 1000;
+  bool     gi_use_adaptive_rays           = true;
+  bool     gi_use_fused_blend             = true;
+  bool     gi_use_compact_atlases         = true;  // R11G11B10 irradiance and RG16 visibility, read once at startup
+  bool     gi_use_compact_gbuffer         = true;  // RG16 normals, RGBA8 albedo and R11G11B10 diffuse instead of RGBA32F, read once at startup
+  bool     gi_use_sh_irradiance           = false;  // L1 SH per probe instead of the octahedral irradiance atlas
+  uint32_t gi_probe_cascades              = 1;  // Cascades of the probe counts, each twice the spacing, read once at startup
+  bool     gi_follow_camera               = false;  // Cascades centred on the camera, scrolled by whole cells
+
+  // Extra volumes, sampled ahead of the main grid where they overlap it. Their number is read once at startup,
+  // each is {{position}, {spacing}, {counts}, rays}.
+
+  // Sponza -> twice as dense over the ground floor colonnade, blending into the main grid at the arches
+  std::vector<Probe_Grid_Settings> gi_extra_volumes{
+      {{-12.000f, 0.426f, -5.500f}, {0.863f, 0.549f, 0.562f}, {28, 8, 20}, 128},
+  };
+
+  // Sibenik, Living Room -> main grid only
+  /*
+  std::vector<Probe_Grid_Settings> gi_extra_volumes;
+  */
+};
+
+
+// One grid of probes. The extra volumes and the cascades of the main grid are stored one after the other in every
+// per probe resource, and sampled in the same order.
+struct Probe_Grid {
+	glm::ivec3 counts{0};
+	glm::vec3  origin{0.0f};   // World position of grid index 0
+	glm::vec3  spacing{1.0f};
+	glm::ivec3 cells{0};       // Grid index 0 in cells of the spacing, from cascade_anchor
+	glm::ivec3 scroll{0};      // Storage slot of grid index 0, in [0, counts)
+	glm::ivec3 delta{0};       // Cells scrolled this frame
+	int32_t    rays			  = PROBE_MAX_RAYS;  // Most rays a probe of the grid traces
+	uint32_t   first_probe	  = 0;  // Probe index of storage slot 0
+	uint32_t   first_layer	  = 0;  // Atlas layer of storage slice z = 0, the offsets texture shares the atlas tiles
+
+	uint32_t get_probe_count() const { return counts.x * counts.y * counts.z; }
+
+	// Moves grid index 0 to a cell and scrolls the storage by as many planes, returns whether any probe was exposed.
+	// A reset exposes every probe.
+	bool place(const glm::ivec3& cell, bool reset) {
+		const glm::ivec3 moved = reset ? counts : cell - cells;
+		cells                  = cell;
+		delta                  = glm::clamp(moved, -counts, counts);
+		scroll                 = ((scroll + delta) % counts + counts) % counts;
+		return delta != glm::ivec3(0);
+	}
 };
 
 
@@ -84,9 +143,11 @@ public:
 	
 
 	int32_t per_frame_probe_updates = 0;
-	int32_t probe_update_offset     = 0;
+	int32_t offsets_calculations_count = PROBE_RELOCATION_FRAMES;  // Frames left tracing the full grid to (re)place the probes
 
-	int32_t probe_rays				= 128;
+	// Both multiples of PROBE_RAY_GRANULARITY, the ray direction table only holds those counts
+	int32_t probe_rays				= PROBE_MAX_RAYS;  // Noisy probes, also the width of the radiance texture
+	int32_t probe_min_rays			= PROBE_RAY_GRANULARITY;   // Converged or dim probes
 
 	int32_t irradiance_atlas_width;
 	int32_t irradiance_atlas_height;
@@ -96,9 +157,205 @@ public:
 	int32_t visibility_atlas_height;
 	int32_t visibility_probe_size	= 6;
 
-	bool half_resolution_output		= false;
 
-	uint32_t get_total_probes() { return probe_count_x * probe_count_y * probe_count_z; }
-	uint32_t get_total_rays() { return probe_rays * probe_count_x * probe_count_y * probe_count_z; }
+	// Storage formats, picked when the textures are created. Compact atlases fall back to RGBA16F without storage support.
+	VkFormat radiance_format		= VK_FORMAT_R16G16B16A16_SFLOAT;  // Radiance and signed hit distance
+	VkFormat irradiance_format		= VK_FORMAT_R16G16B16A16_SFLOAT;
+	VkFormat visibility_format		= VK_FORMAT_R16G16B16A16_SFLOAT;
+	bool     compact_atlases		= false;
+	VkFormat sh_format				= VK_FORMAT_R16G16B16A16_SFLOAT;  // PROBE_SH_COEFFICIENTS texels per probe
+	bool     sh_irradiance			= false;  // Irradiance read from the SH coefficients, the atlas is left untouched
+
+	// Volumes: the extra volumes first, then the cascades of the main grid from finest to coarsest
+	Probe_Grid volumes[PROBE_MAX_VOLUMES]{};
+	uint32_t   volume_count			= 1;
+	uint32_t   cascade_count		= 1;
+	uint32_t   first_cascade		= 0;  // Volume of cascade 0
+	uint32_t   atlas_tile_columns	= 0;  // Tiles of an atlas layer and texels of an offsets layer
+	uint32_t   atlas_tile_rows		= 0;
+	uint32_t   atlas_layers			= 0;  // One layer per z slice of every volume
+	bool       volumes_placed		= false;
+	bool       volumes_scrolled		= false;  // Some volume exposed new probes this frame
+	bool       cascades_follow		= false;
+	bool       cascades_placed		= false;
+	bool       cascades_reset		= false;  // Every probe was exposed this frame, the offsets are placed again over the full grid
+	glm::vec3  cascade_anchor{0.0f};   // Grid position of the last full placement, the cells count from there
+	glm::vec3  placed_spacing{0.0f};   // Spacing of the last placement
+
+	uint32_t get_cascade_probes() { return probe_count_x * probe_count_y * probe_count_z; }
+	uint32_t get_total_probes() { return volumes[volume_count - 1].first_probe + volumes[volume_count - 1].get_probe_count(); }
+	uint32_t get_total_rays() { return probe_rays * get_total_probes(); }
+
+	static float get_cascade_scale(uint32_t cascade) { return float(1u << cascade); }
+
+	// Lays the volumes out once at startup. Probe indices and atlas layers follow the volume order, a layer holds one
+	// z slice of a volume and is as wide and as tall as the largest. The radiance texture is as wide as the most rays
+	// of any volume.
+	// Every per probe texture has a row per probe, so the volumes have to fit max_rows probes and max_layers atlas
+	// layers: the coarsest cascades are dropped first, then the last extra volumes.
+	void create_volumes(const std::vector<Probe_Grid_Settings>& extra_volumes, uint32_t cascades, uint32_t max_rows, uint32_t max_layers) {
+		cascade_count = glm::clamp(cascades, 1u, uint32_t(PROBE_MAX_CASCADES));
+		first_cascade = glm::min(uint32_t(extra_volumes.size()), uint32_t(PROBE_MAX_VOLUMES) - cascade_count);
+
+		auto fits = [&]() {
+			uint64_t probes = uint64_t(get_cascade_probes()) * cascade_count;
+			uint64_t layers = uint64_t(probe_count_z) * cascade_count;
+			for(uint32_t v = 0; v < first_cascade; ++v) {
+				const glm::uvec3 counts = glm::max(extra_volumes[v].counts, glm::uvec3(2));
+				probes += counts.x * counts.y * counts.z;
+				layers += counts.z;
+			}
+			return probes <= max_rows && layers <= max_layers;
+		};
+		const uint32_t requested_cascades = cascade_count;
+		const uint32_t requested_volumes  = first_cascade;
+		while(cascade_count > 1 && !fits()) {
+			--cascade_count;
+		}
+		while(first_cascade > 0 && !fits()) {
+			--first_cascade;
+		}
+		if(cascade_count != requested_cascades || first_cascade != requested_volumes) {
+			LOGW("Probe volumes exceed the image limits (%u rows, %u layers), using %u of %u extra volumes and %u of %u cascades\n",
+			     max_rows, max_layers, first_cascade, requested_volumes, cascade_count, requested_cascades);
+		}
+		volume_count = first_cascade + cascade_count;
+
+		const int32_t main_rays   = probe_rays;
+		uint32_t      first_probe = 0;
+		atlas_tile_columns        = 0;
+		atlas_tile_rows           = 0;
+		atlas_layers              = 0;
+		for(uint32_t v = 0; v < volume_count; ++v) {
+			Probe_Grid& grid = volumes[v];
+			if(v < first_cascade) {
+				const int32_t rays = (extra_volumes[v].rays / PROBE_RAY_GRANULARITY) * PROBE_RAY_GRANULARITY;
+				grid.counts        = glm::max(glm::ivec3(extra_volumes[v].counts), glm::ivec3(2));
+				grid.rays          = glm::clamp(rays, int32_t(PROBE_RAY_GRANULARITY), int32_t(PROBE_MAX_RAYS));
+				probe_rays         = glm::max(probe_rays, grid.rays);
+			}
+			else {
+				grid.counts = glm::ivec3(probe_count_x, probe_count_y, probe_count_z);
+				grid.rays   = main_rays;
+			}
+			grid.first_probe    = first_probe;
+			grid.first_layer    = atlas_layers;
+			first_probe += grid.get_probe_count();
+			atlas_layers += grid.counts.z;
+			atlas_tile_columns = glm::max(atlas_tile_columns, uint32_t(grid.counts.x));
+			atlas_tile_rows    = glm::max(atlas_tile_rows, uint32_t(grid.counts.y));
+		}
+	}
+
+	// Extra volumes stay where the settings put them. Moving one or changing its spacing exposes all of its probes,
+	// each relocated on its own like after a scroll.
+	void update_extra_volumes(const std::vector<Probe_Grid_Settings>& extra_volumes) {
+		for(uint32_t v = 0; v < first_cascade; ++v) {
+			Probe_Grid& grid  = volumes[v];
+			const bool  moved = !volumes_placed || grid.origin != extra_volumes[v].position || grid.spacing != extra_volumes[v].spacing;
+			grid.origin       = extra_volumes[v].position;
+			grid.spacing      = extra_volumes[v].spacing;
+			volumes_scrolled  = grid.place(grid.cells, moved) || volumes_scrolled;
+		}
+		volumes_placed = true;
+	}
+
+	// Places every cascade for this frame. A cascade moves by whole cells of its spacing and scrolls by as many probe
+	// planes, following the camera or, otherwise, the grid centred on grid_position. Moving grid_position by whole cells
+	// of the first cascade keeps the history of every probe still inside the grid.
+	// The first placement, a change of spacing, a move by a fraction of a cell and switching between the two modes
+	// expose every probe.
+	void update_cascades(bool follow_camera, const glm::vec3& camera_position, const glm::vec3& grid_position, const glm::vec3& spacing) {
+		const glm::ivec3 counts{probe_count_x, probe_count_y, probe_count_z};
+		if(follow_camera != cascades_follow || spacing != placed_spacing) {
+			cascades_follow = follow_camera;
+			cascades_placed = false;
+		}
+		placed_spacing = spacing;
+
+		glm::vec3 focus = camera_position;
+		if(follow_camera) {
+			cascade_anchor = glm::vec3(0.0f);
+		}
+		else {
+			const glm::vec3 shift       = (grid_position - cascade_anchor) / spacing;
+			const bool      whole_cells = glm::all(glm::lessThan(glm::abs(shift - glm::round(shift)), glm::vec3(1e-3f)));
+			if(!cascades_placed || !whole_cells) {
+				cascade_anchor  = grid_position;
+				cascades_placed = false;
+			}
+			focus = grid_position + spacing * glm::vec3(counts - 1) * 0.5f;
+		}
+
+		cascades_reset   = !cascades_placed;
+		volumes_scrolled = false;
+		for(uint32_t cascade = 0; cascade < cascade_count; ++cascade) {
+			Probe_Grid&     grid            = volumes[first_cascade + cascade];
+			const glm::vec3 cascade_spacing = spacing * get_cascade_scale(cascade);
+			const glm::vec3 cells           = (focus - cascade_anchor) / cascade_spacing;
+
+			// The camera sits in the cell above the middle of the grid, the grid position is the corner of cascade 0
+			// and every other cascade is centred on it up to one of its own cells
+			const glm::ivec3 cell = follow_camera ? glm::ivec3(glm::floor(cells)) - counts / 2 :
+			                                        glm::ivec3(glm::floor(cells - glm::vec3(counts - 1) * 0.5f + 0.5f));
+			grid.origin      = cascade_anchor + glm::vec3(cell) * cascade_spacing;
+			grid.spacing     = cascade_spacing;
+			volumes_scrolled = grid.place(cell, !cascades_placed) || volumes_scrolled;
+		}
+		cascades_placed = true;
+	}
+
+	// Update budget of a frame: the `per_frame_probe_updates` highest priority probes,
+	// or the whole grid while the offsets are being placed
+	uint32_t get_scheduled_probes() {
+		if(offsets_calculations_count >= 0 || per_frame_probe_updates <= 0) {
+			return get_total_probes();
+		}
+		return glm::min(static_cast<uint32_t>(per_frame_probe_updates), get_total_probes());
+	}
+	// A probe skipped for this many frames is forced into the list, twice the length of a plain round-robin
+	uint32_t get_probe_age_horizon() {
+		const uint32_t budget = glm::max(get_scheduled_probes(), 1u);
+		return 2 * ((get_total_probes() + budget - 1) / budget);
+	}
+
+	static uint32_t get_format_size(VkFormat format) {
+		switch(format) {
+			case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+			case VK_FORMAT_R16G16_SFLOAT:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_D32_SFLOAT:
+				return 4;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return 8;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return 16;
+			default:
+				return 0;
+		}
+	}
+
+	// Bytes held by the radiance texture, both atlases and the SH coefficients
+	uint64_t get_texture_memory() {
+		const uint64_t radiance   = uint64_t(probe_rays) * get_total_probes() * get_format_size(radiance_format);
+		const uint64_t irradiance = uint64_t(irradiance_atlas_width) * irradiance_atlas_height * atlas_layers * get_format_size(irradiance_format);
+		const uint64_t visibility = uint64_t(visibility_atlas_width) * visibility_atlas_height * atlas_layers * get_format_size(visibility_format);
+		const uint64_t sh         = uint64_t(PROBE_SH_COEFFICIENTS) * get_total_probes() * get_format_size(sh_format);
+		return radiance + irradiance + visibility + sh;
+	}
+
+	// Estimated bytes moved per frame: the scheduled probe tiles read and written by the blends,
+	// and 8 probes x 4 bilinear texels of both atlases for every sampled pixel.
+	// In SH mode the irradiance tile is replaced by the coefficients, fetched unfiltered.
+	uint64_t get_blend_bandwidth() {
+		const uint64_t irradiance_tile = sh_irradiance ? uint64_t(PROBE_SH_COEFFICIENTS) * get_format_size(sh_format)
+		                                               : uint64_t(irradiance_probe_size + 2) * (irradiance_probe_size + 2) * get_format_size(irradiance_format);
+		const uint64_t visibility_tile = uint64_t(visibility_probe_size + 2) * (visibility_probe_size + 2) * get_format_size(visibility_format);
+		return 2 * get_scheduled_probes() * (irradiance_tile + visibility_tile);
+	}
+	uint64_t get_sample_bandwidth(uint64_t sampled_pixels) {
+		const uint64_t irradiance_texels = sh_irradiance ? uint64_t(PROBE_SH_COEFFICIENTS) * get_format_size(sh_format) : 4 * get_format_size(irradiance_format);
+		return sampled_pixels * 8 * (irradiance_texels + 4 * get_format_size(visibility_format));
+	}
 
 };
\ No newline at end of file
@@ -34,15 +34,7 @@ void HelloVulkan::setup(const VkInstance& instance, const VkDevice& device, cons
   m_alloc.init(instance, device, physicalDevice);
   m_debug.setup(m_device);
   m_offscreenDepthFormat = nvvk::findDepthFormat(physicalDevice);
-  m_gBufferDepthFormat   = nvvk::findDepthFormat(physicalDevice);
   m_debugDepthFormat     = nvvk::findDepthFormat(physicalDevice);
-
-  VkQueryPoolCreateInfo queryPoolInfo = {};
-  queryPoolInfo.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-  queryPoolInfo.queryType             = VK_QUERY_TYPE_TIMESTAMP;
-  queryPoolInfo.queryCount            = 7;  // Adjust the count as per your needs
-
-  vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &queryPool);
 }
 
 
@@ -50,7 +42,7 @@ void HelloVulkan::setup(const VkInstance& instance, const VkDevice& device, cons
 //--------------------------------------------------------------------------------------------------
 // Called at each frame to update the camera matrix
 //
-void HelloVulkan::updateUniformBuffer(const VkCommandBuffer& cmdBuf) {
+void HelloVulkan::updateUniformBuffer() {
   // Prepare new UBO contents on host.
   const float    aspectRatio = m_size.width / static_cast<float>(m_size.height);
   GlobalUniforms hostUBO     = {};
@@ -66,34 +58,13 @@ void HelloVulkan::updateUniformBuffer(const VkCommandBuffer& cmdBuf) {
   hostUBO.projection  = proj;
   hostUBO.position    = pos;
 
-  // UBO on the device, and what stages access it.
-  VkBuffer deviceUBO      = m_bGlobals.buffer;
-  auto     uboUsageStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
-
-  // Ensure that the modified UBO is not visible to previous frames.
-  VkBufferMemoryBarrier beforeBarrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  beforeBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  beforeBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  beforeBarrier.buffer        = deviceUBO;
-  beforeBarrier.offset        = 0;
-  beforeBarrier.size          = sizeof(hostUBO);
-  vkCmdPipelineBarrier(cmdBuf, uboUsageStages, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0,
-                       nullptr, 1, &beforeBarrier, 0, nullptr);
-
-
-  // Schedule the host-to-device upload. (hostUBO is copied into the cmd
-  // buffer so it is okay to deallocate when the function returns).
-  vkCmdUpdateBuffer(cmdBuf, m_bGlobals.buffer, 0, sizeof(GlobalUniforms), &hostUBO);
-
-  // Making sure the updated UBO will be visible.
-  VkBufferMemoryBarrier afterBarrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  afterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  afterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  afterBarrier.buffer        = deviceUBO;
-  afterBarrier.offset        = 0;
-  afterBarrier.size          = sizeof(hostUBO);
-  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, uboUsageStages, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0,
-                       nullptr, 1, &afterBarrier, 0, nullptr);
+  // Motion vectors against last frame's camera, none on the first frame
+  hostUBO.prevViewProj = m_hasPrevViewProj ? m_prevViewProj : hostUBO.viewProj;
+  m_prevViewProj       = hostUBO.viewProj;
+  m_hasPrevViewProj    = true;
+
+  // Written straight into the slot of this frame, the GPU may still be reading the other slots
+  memcpy(m_globalsMapped + m_globalsStride * getCurFrame(), &hostUBO, sizeof(GlobalUniforms));
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -103,7 +74,7 @@ void HelloVulkan::createDescriptorSetLayout() {
   auto nbTxt = static_cast<uint32_t>(m_textures.size());
 
   // Camera matrices
-  m_descSetLayoutBind.addBinding(SceneBindings::eGlobals, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+  m_descSetLayoutBind.addBinding(SceneBindings::eGlobals, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1,
                                  VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);
   // Obj descriptions
   m_descSetLayoutBind.addBinding(SceneBindings::eObjDescs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
@@ -125,7 +96,7 @@ void HelloVulkan::updateDescriptorSet() {
   std::vector<VkWriteDescriptorSet> writes;
 
   // Camera matrices and scene description
-  VkDescriptorBufferInfo dbiUnif{m_bGlobals.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo dbiUnif{m_bGlobals.buffer, 0, sizeof(GlobalUniforms)};
   writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descSet, SceneBindings::eGlobals, &dbiUnif));
 
   VkDescriptorBufferInfo dbiSceneDesc{m_bObjDesc.buffer, 0, VK_WHOLE_SIZE};
@@ -225,8 +196,11 @@ void HelloVulkan::loadModel(const std::string& filename, glm::mat4 transform, fl
   model.matColorBuffer = m_alloc.createBuffer(cmdBuf, loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
   model.matIndexBuffer = m_alloc.createBuffer(cmdBuf, loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
   // Creates all textures found and find the offset for this model
-  auto txtOffset = static_cast<uint32_t>(m_textures.size());
-  createTextureImages(cmdBuf, loader.m_textures);
+  auto                       txtOffset = static_cast<uint32_t>(m_textures.size());
+  std::vector<TextureTexels> texels;
+  createTextureImages(cmdBuf, loader.m_textures, &texels);
+  // Albedo and normal of every triangle, the probe rays read them instead of the vertices, material and texture
+  model.surfaceBuffer = m_alloc.createBuffer(cmdBuf, buildSurfaceCache(loader, texels), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
   cmdBufGet.submitAndWait(cmdBuf);
   m_alloc.finalizeAndReleaseStaging();
 
@@ -235,6 +209,7 @@ void HelloVulkan::loadModel(const std::string& filename, glm::mat4 transform, fl
   m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb)));
   m_debug.setObjectName(model.matColorBuffer.buffer, (std::string("mat_" + objNb)));
   m_debug.setObjectName(model.matIndexBuffer.buffer, (std::string("matIdx_" + objNb)));
+  m_debug.setObjectName(model.surfaceBuffer.buffer, (std::string("surface_" + objNb)));
 
   // Keeping transformation matrix of the instance
   ObjInstance instance;
@@ -254,6 +229,7 @@ void HelloVulkan::loadModel(const std::string& filename, glm::mat4 transform, fl
   desc.indexAddress         = nvvk::getBufferDeviceAddress(m_device, model.indexBuffer.buffer);
   desc.materialAddress      = nvvk::getBufferDeviceAddress(m_device, model.matColorBuffer.buffer);
   desc.materialIndexAddress = nvvk::getBufferDeviceAddress(m_device, model.matIndexBuffer.buffer);
+  desc.surfaceAddress       = nvvk::getBufferDeviceAddress(m_device, model.surfaceBuffer.buffer);
 
   // Keeping the obj host model and device description
   m_objModel.emplace_back(model);
@@ -322,6 +298,7 @@ void HelloVulkan::loadDebugMesh(const std::string& filename, glm::mat4 transform
   desc.indexAddress         = nvvk::getBufferDeviceAddress(m_device, model.indexBuffer.buffer);
   desc.materialAddress      = nvvk::getBufferDeviceAddress(m_device, model.matColorBuffer.buffer);
   desc.materialIndexAddress = nvvk::getBufferDeviceAddress(m_device, model.matIndexBuffer.buffer);
+  desc.surfaceAddress       = 0;  // Debug meshes are rasterised only
 
   // Keeping the obj host model and device description
   m_debugObjModel.emplace_back(model);
@@ -330,13 +307,46 @@ void HelloVulkan::loadDebugMesh(const std::string& filename, glm::mat4 transform
 
 
 
+//--------------------------------------------------------------------------------------------------
+// Creating a ring of per-frame constants
+// - One slot per swapchain image, aligned to minUniformBufferOffsetAlignment
+// - Buffer is host visible and stays mapped for the lifetime of the application
+//
+nvvk::Buffer HelloVulkan::createFrameRing(VkDeviceSize size, VkDeviceSize& stride, uint8_t*& mapped) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+  const VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+  stride = nvh::align_up(size, alignment);
+
+  VkBufferCreateInfo ringInfo = nvvk::makeBufferCreateInfo(stride * m_swapChain.getImageCount(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  setAsyncSharing(ringInfo);
+
+  nvvk::Buffer ring = m_alloc.createBuffer(ringInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  mapped = reinterpret_cast<uint8_t*>(m_alloc.map(ring));
+  return ring;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Dynamic offsets of the current frame, in set order:
+// the indirect constants of the RT set (set 0) then the globals of the scene set
+//
+std::vector<uint32_t> HelloVulkan::frameDynamicOffsets(bool withRtSet) {
+  const uint32_t        frame = getCurFrame();
+  std::vector<uint32_t> offsets;
+  if(withRtSet) {
+    offsets.push_back(static_cast<uint32_t>(m_indirectConstantsStride * frame));
+  }
+  offsets.push_back(static_cast<uint32_t>(m_globalsStride * frame));
+  return offsets;
+}
+
 //--------------------------------------------------------------------------------------------------
 // Creating the uniform buffer holding the camera matrices
-// - Buffer is host visible
+// - Buffer is host visible, one slot per frame in flight
 //
 void HelloVulkan::createUniformBuffer() {
-  m_bGlobals = m_alloc.createBuffer(sizeof(GlobalUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_bGlobals = createFrameRing(sizeof(GlobalUniforms), m_globalsStride, m_globalsMapped);
   m_debug.setObjectName(m_bGlobals.buffer, "Globals");
 }
 
@@ -360,7 +370,8 @@ void HelloVulkan::createObjDescriptionBuffer() {
 //--------------------------------------------------------------------------------------------------
 // Creating all textures and samplers
 //
-void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures) {
+void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures,
+                                      std::vector<TextureTexels>* texels) {
   VkSamplerCreateInfo samplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
   samplerCreateInfo.minFilter  = VK_FILTER_LINEAR;
   samplerCreateInfo.magFilter  = VK_FILTER_LINEAR;
@@ -420,11 +431,138 @@ void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::
         m_textures.push_back(texture);
       }
 
+      if(texels) {
+        texels->emplace_back(makeTextureTexels(pixels, texWidth, texHeight));
+      }
+
       stbi_image_free(stbi_pixels);
     }
   }
 }
 
+
+//--------------------------------------------------------------------------------------------------
+// Linear copy of the texture, box filtered to at most 128 texels a side and then halved down to 1x1.
+// A per triangle average does not need anything finer, and the copy stays small for large textures.
+//
+HelloVulkan::TextureTexels HelloVulkan::makeTextureTexels(const uint8_t* pixels, int width, int height) {
+  // Same 2.2 power the materials are linearised with
+  std::array<float, 256> linear;
+  for(int i = 0; i < 256; i++) {
+    linear[i] = std::pow(i / 255.0f, 2.2f);
+  }
+
+  const int  stepX = (width + 127) / 128;
+  const int  stepY = (height + 127) / 128;
+  glm::uvec2 size((width + stepX - 1) / stepX, (height + stepY - 1) / stepY);
+
+  std::vector<glm::vec3> level(size.x * size.y, glm::vec3(0.0f));
+  std::vector<float>     count(size.x * size.y, 0.0f);
+  for(int y = 0; y < height; y++) {
+    for(int x = 0; x < width; x++) {
+      const uint8_t* p     = pixels + 4 * (static_cast<size_t>(y) * width + x);
+      const uint32_t index = (y / stepY) * size.x + x / stepX;
+      level[index] += glm::vec3(linear[p[0]], linear[p[1]], linear[p[2]]);
+      count[index] += 1.0f;
+    }
+  }
+  for(size_t i = 0; i < level.size(); i++) {
+    level[i] /= count[i];
+  }
+
+  TextureTexels texels;
+  texels.sizes.push_back(size);
+  texels.levels.push_back(std::move(level));
+
+  while(size != glm::uvec2(1)) {
+    const glm::uvec2 parentSize = size;
+    size                        = glm::max(size / 2u, glm::uvec2(1));
+
+    // Each texel averages the parent texels it covers, three of them along an odd side
+    const std::vector<glm::vec3>& parent = texels.levels.back();
+    std::vector<glm::vec3>        child(size.x * size.y);
+    for(uint32_t y = 0; y < size.y; y++) {
+      for(uint32_t x = 0; x < size.x; x++) {
+        glm::vec3 sum(0.0f);
+        float     samples = 0.0f;
+        for(uint32_t py = y * parentSize.y / size.y; py < (y + 1) * parentSize.y / size.y; py++) {
+          for(uint32_t px = x * parentSize.x / size.x; px < (x + 1) * parentSize.x / size.x; px++) {
+            sum += parent[py * parentSize.x + px];
+            samples += 1.0f;
+          }
+        }
+        child[y * size.x + x] = sum / samples;
+      }
+    }
+
+    texels.sizes.push_back(size);
+    texels.levels.push_back(std::move(child));
+  }
+
+  return texels;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Nearest texel of the level whose texels are about as large as the triangle in uv space,
+// so one fetch returns the texture averaged over the triangle
+//
+glm::vec3 HelloVulkan::TextureTexels::sample(glm::vec2 uv, float uvArea) const {
+  const float footprint = uvArea * static_cast<float>(sizes[0].x) * static_cast<float>(sizes[0].y);
+  const float lod       = 0.5f * std::log2(std::max(footprint, 1.0f));
+  const auto  mip       = std::min(static_cast<size_t>(lod + 0.5f), levels.size() - 1);
+
+  const glm::uvec2 size = sizes[mip];
+  const glm::vec2  wrap = uv - glm::floor(uv);
+  const uint32_t   x    = std::min(static_cast<uint32_t>(wrap.x * size.x), size.x - 1);
+  const uint32_t   y    = std::min(static_cast<uint32_t>(wrap.y * size.y), size.y - 1);
+  return levels[mip][y * size.x + x];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// One record per triangle: the material colours times the texture over the triangle, and the
+// vertex normals averaged at the centroid. Ambient only counts for the illumination models using it,
+// like computeDiffuse.
+//
+std::vector<SurfaceRecord> HelloVulkan::buildSurfaceCache(const ObjLoader& loader, const std::vector<TextureTexels>& texels) {
+  const size_t               triangleCount = loader.m_indices.size() / 3;
+  std::vector<SurfaceRecord> records(triangleCount);
+
+  for(size_t t = 0; t < triangleCount; t++) {
+    const VertexObj&   v0  = loader.m_vertices[loader.m_indices[3 * t + 0]];
+    const VertexObj&   v1  = loader.m_vertices[loader.m_indices[3 * t + 1]];
+    const VertexObj&   v2  = loader.m_vertices[loader.m_indices[3 * t + 2]];
+    const MaterialObj& mat = loader.m_materials[loader.m_matIndx[t]];
+
+    // Falls back to the face normal when the vertex normals cancel out or are missing
+    glm::vec3 normal = v0.nrm + v1.nrm + v2.nrm;
+    if(glm::dot(normal, normal) < 1e-12f) {
+      normal = glm::cross(v1.pos - v0.pos, v2.pos - v0.pos);
+    }
+    normal = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+    glm::vec3 texture(1.0f);
+    if(mat.textureID >= 0 && mat.textureID < static_cast<int>(texels.size())) {
+      const glm::vec2 uv     = (v0.texCoord + v1.texCoord + v2.texCoord) / 3.0f;
+      const glm::vec2 edge1  = v1.texCoord - v0.texCoord;
+      const glm::vec2 edge2  = v2.texCoord - v0.texCoord;
+      const float     uvArea = 0.5f * std::abs(edge1.x * edge2.y - edge1.y * edge2.x);
+      texture                = texels[mat.textureID].sample(uv, uvArea);
+    }
+
+    const glm::vec3 albedo  = glm::clamp(mat.diffuse * texture, 0.0f, 1.0f);
+    const glm::vec3 ambient = mat.illum >= 1 ? glm::clamp(mat.ambient * texture, 0.0f, 1.0f) : glm::vec3(0.0f);
+
+    // Square root before the 8 bit quantisation keeps the dark colours, the shader squares them back
+    records[t].albedo  = glm::packUnorm4x8(glm::vec4(glm::sqrt(albedo), 1.0f));
+    records[t].ambient = glm::packUnorm4x8(glm::vec4(glm::sqrt(ambient), 1.0f));
+    records[t].normal  = glm::packSnorm2x16(Util::octEncode(normal));
+  }
+
+  return records;
+}
+
 //--------------------------------------------------------------------------------------------------
 // Destroying all allocations
 //
@@ -434,10 +572,18 @@ void HelloVulkan::destroyResources() {
   vkDestroyDescriptorPool(m_device, m_descPool, nullptr);
   vkDestroyDescriptorSetLayout(m_device, m_descSetLayout, nullptr);
 
+  m_alloc.unmap(m_bGlobals);
   m_alloc.destroy(m_bGlobals);
   m_alloc.destroy(m_bObjDesc);
+  m_alloc.unmap(m_bIndirectConstants);
   m_alloc.destroy(m_bIndirectConstants);
   m_alloc.destroy(m_bIndirectStatus);
+  m_alloc.destroy(m_bActiveProbes);
+  m_alloc.destroy(m_bProbeSchedule);
+  m_alloc.destroy(m_bRayDirections);
+  m_alloc.destroy(m_bSampleTiles);
+
+  destroyAsyncCompute();
 
 
   for(auto& m : m_objModel) {
@@ -445,6 +591,7 @@ void HelloVulkan::destroyResources() {
     m_alloc.destroy(m.indexBuffer);
     m_alloc.destroy(m.matColorBuffer);
     m_alloc.destroy(m.matIndexBuffer);
+    m_alloc.destroy(m.surfaceBuffer);
   }
   
   for(auto& m : m_debugObjModel){
@@ -465,7 +612,13 @@ void HelloVulkan::destroyResources() {
   m_alloc.destroy(m_irradianceTexture);
   m_alloc.destroy(m_offsetsTexture);
   m_alloc.destroy(m_visibilityTexture);
+  m_alloc.destroy(m_probeSHTexture);
   m_alloc.destroy(m_indirectTexture);
+  m_alloc.destroy(m_indirectLowResTexture);
+  for(size_t i = 0; i < m_indirectHistoryTextures.size(); ++i) {
+    m_alloc.destroy(m_indirectHistoryTextures[i]);
+    m_alloc.destroy(m_indirectGuideTextures[i]);
+  }
   
   
   for(auto& sample : m_globalTextureSamplers) {
@@ -478,6 +631,7 @@ void HelloVulkan::destroyResources() {
   m_alloc.destroy(m_gBufferDepth);
   m_alloc.destroy(m_gBufferAlbedo);
   m_alloc.destroy(m_gBufferDiffuse);
+  m_alloc.destroy(m_gBufferMotion);
   vkDestroyPipeline(m_device, m_gBufferPipeline, nullptr);
   vkDestroyPipelineLayout(m_device, m_gBufferPipelineLayout, nullptr);
   vkDestroyRenderPass(m_device, m_gBufferRenderPass, nullptr);
@@ -498,16 +652,23 @@ void HelloVulkan::destroyResources() {
   vkDestroyPipeline(m_device, m_IndirectPipeline, nullptr);
   vkDestroyPipelineLayout(m_device, m_IndirectPipelineLayout, nullptr);
   // Compute
-  vkDestroyPipeline(m_device, m_probeOffsetsPipeline, nullptr);
-  vkDestroyPipelineLayout(m_device, m_probeOffsetsPipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_probeStatusPipeline, nullptr);
-  vkDestroyPipelineLayout(m_device, m_probeStatusPipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_probeUpdateIrradiancePipeline, nullptr);
-  vkDestroyPipelineLayout(m_device, m_probeUpdateIrradiancePipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_probeUpdateVisibilityPipeline, nullptr);
-  vkDestroyPipelineLayout(m_device, m_probeUpdateVisibilityPipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_sampleIrradiancePipeline, nullptr);
-  vkDestroyPipelineLayout(m_device, m_sampleIrradiancePipelineLayout, nullptr);
+  m_probeOffsetsPipeline.destroy(m_device);
+  m_probeStatusPipeline.destroy(m_device);
+  m_probeScrollPipeline.destroy(m_device);
+  m_probePriorityPipeline.destroy(m_device);
+  m_probeThresholdPipeline.destroy(m_device);
+  m_probeCompactPipeline.destroy(m_device);
+  m_probeDirectionsPipeline.destroy(m_device);
+  m_probeUpdateIrradiancePipeline.destroy(m_device);
+  m_probeUpdateVisibilityPipeline.destroy(m_device);
+  m_probeUpdateFusedPipeline.destroy(m_device);
+  m_probeUpdateSHPipeline.destroy(m_device);
+  m_probeBorderPipeline.destroy(m_device);
+  m_sampleClassifyPipeline.destroy(m_device);
+  m_sampleIrradiancePipeline.destroy(m_device);
+  m_sampleCoherentPipeline.destroy(m_device);
+  m_indirectUpsamplePipeline.destroy(m_device);
+  m_indirectTemporalPipeline.destroy(m_device);
 
   vkDestroyRenderPass(m_device, m_IndirectRenderPass, nullptr);
   vkDestroyFramebuffer(m_device, m_IndirectFramebuffer, nullptr);
@@ -551,7 +712,9 @@ void HelloVulkan::rasterize(const VkCommandBuffer& cmdBuf) {
 
   // Drawing all triangles
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descSet, 0, nullptr);
+  std::vector<uint32_t> dynamicOffsets = frameDynamicOffsets(false);
+  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descSet,
+                          (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
 
 
   for(const HelloVulkan::ObjInstance& inst : m_instances) {
@@ -668,14 +831,6 @@ void HelloVulkan::createPostPipeline() {
   createInfo.pPushConstantRanges    = &pushConstantRanges;
   vkCreatePipelineLayout(m_device, &createInfo, nullptr, &m_postPipelineLayout);
 
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-    genCmdBuf.submitAndWait(cmdBuf);
-  }
-
   // Pipeline: completely generic, no vertices
   nvvk::GraphicsPipelineGeneratorCombined pipelineGenerator(m_device, m_postPipelineLayout, m_renderPass);
   pipelineGenerator.addShader(nvh::loadFile("spv/passthrough.vert.spv", true, defaultSearchPaths, true), VK_SHADER_STAGE_VERTEX_BIT);
@@ -734,6 +889,7 @@ void HelloVulkan::drawPost(VkCommandBuffer cmdBuf, bool useIndirect, bool showPr
   pcPost.debug_enabled    = showProbes == true ? 1 : 0;
   pcPost.debug_texture    = volume.m_currentTextureDebug;
   pcPost.show_textures    = volume.m_showDebugTextures == true ? 1 : 0;
+  pcPost.indirect_texture = isTemporalAccumulating() ? 10 + getTemporalOutput() : 6;
   setViewport(cmdBuf);
 
   auto aspectRatio = static_cast<float>(m_size.width) / static_cast<float>(m_size.height);
@@ -744,7 +900,9 @@ void HelloVulkan::drawPost(VkCommandBuffer cmdBuf, bool useIndirect, bool showPr
 
   vkCmdPushConstants(cmdBuf, m_postPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstantPost), &pcPost);
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_postPipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_postPipelineLayout, 0, descSets.size(), descSets.data(), 0, nullptr);
+  std::vector<uint32_t> dynamicOffsets = frameDynamicOffsets();
+  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_postPipelineLayout, 0, descSets.size(), descSets.data(),
+                          (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
   vkCmdDraw(cmdBuf, 3, 1, 0, 0);
 
   m_debug.endLabel(cmdBuf);
@@ -755,18 +913,47 @@ void HelloVulkan::drawPost(VkCommandBuffer cmdBuf, bool useIndirect, bool showPr
 //////////////////////////////////////////////////////////////////////////
 // G Buffer
 //////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------------------
+// Compact: RG16F octahedral normals, sRGB albedo and R11G11B10 diffuse light, 20 bytes per pixel with the
+// motion vectors and depth. Otherwise RGBA32F targets, kept to compare the cost of the G-buffer pass.
+// Positions always come from the depth attachment.
+//
+void HelloVulkan::selectGBufferFormats(bool compact) {
+  auto attachmentSupport = [this](VkFormat format) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+    const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+  };
+
+  m_gBufferNormalFormat  = compact ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
+  m_gBufferAlbedoFormat  = compact ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R32G32B32A32_SFLOAT;
+  m_gBufferDiffuseFormat = compact ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R32G32B32A32_SFLOAT;
+  if(compact && !attachmentSupport(m_gBufferDiffuseFormat)) {
+    LOGI("R11G11B10 can't be rendered to, falling back to RGBA16F for the G-buffer diffuse light\n");
+    m_gBufferDiffuseFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+  }
+}
+
+uint32_t HelloVulkan::getGBufferBytesPerPixel() const {
+  return Probe_Volume::get_format_size(m_gBufferNormalFormat) + Probe_Volume::get_format_size(m_gBufferAlbedoFormat)
+         + Probe_Volume::get_format_size(m_gBufferDiffuseFormat) + Probe_Volume::get_format_size(m_gBufferMotionFormat)
+         + Probe_Volume::get_format_size(m_gBufferDepthFormat);
+}
+
 void HelloVulkan::createGBufferRender()
 {
   // Destroying existing resources
   m_alloc.destroy(m_gBufferNormals);
-  m_alloc.destroy(m_gBufferDepthTexture);
   m_alloc.destroy(m_gBufferAlbedo);
   m_alloc.destroy(m_gBufferDiffuse);
+  m_alloc.destroy(m_gBufferMotion);
   m_alloc.destroy(m_gBufferDepth);
 
   // Creating the normal image (first colour attachment)
   {
-    auto                  normalsCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferNormalFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+    auto                  normalsCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferNormalFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     nvvk::Image           image             = m_alloc.createImage(normalsCreateInfo);
     VkImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, normalsCreateInfo);
     VkSamplerCreateInfo   sampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
@@ -774,19 +961,9 @@ void HelloVulkan::createGBufferRender()
     m_gBufferNormals.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
   }
 
-  // Creating the depth image (second colour attachment)
+  // Creating the albedo image (second colour attachment)
   {
-    auto                  depthTextureCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferDepthTextureFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
-    nvvk::Image           image  = m_alloc.createImage(depthTextureCreateInfo);
-    VkImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, depthTextureCreateInfo);
-    VkSamplerCreateInfo   sampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
-    m_gBufferDepthTexture                  = m_alloc.createTexture(image, ivInfo, sampler);
-    m_gBufferDepthTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-  }
-
-  // Creating the albedo image (third colour attachment)
-  {
-    auto                  albedoCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferAlbedoFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+    auto                  albedoCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferAlbedoFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     nvvk::Image           image            = m_alloc.createImage(albedoCreateInfo);
     VkImageViewCreateInfo ivInfo           = nvvk::makeImageViewCreateInfo(image.image, albedoCreateInfo);
     VkSamplerCreateInfo   sampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
@@ -794,9 +971,9 @@ void HelloVulkan::createGBufferRender()
     m_gBufferAlbedo.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
   }
 
-  // Creating the diffuse image (forth colour attachment)
+  // Creating the diffuse image (third colour attachment)
   {
-    auto                  diffuseCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferDiffuseFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+    auto                  diffuseCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferDiffuseFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     nvvk::Image           image             = m_alloc.createImage(diffuseCreateInfo);
     VkImageViewCreateInfo ivInfo            = nvvk::makeImageViewCreateInfo(image.image, diffuseCreateInfo);
     VkSamplerCreateInfo   sampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
@@ -804,9 +981,19 @@ void HelloVulkan::createGBufferRender()
     m_gBufferDiffuse.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
   }
 
-  // Creating the depth buffer
+  // Creating the motion vector image (fourth colour attachment)
   {
-    auto depthCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    auto                  motionCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferMotionFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    nvvk::Image           image            = m_alloc.createImage(motionCreateInfo);
+    VkImageViewCreateInfo ivInfo           = nvvk::makeImageViewCreateInfo(image.image, motionCreateInfo);
+    VkSamplerCreateInfo   sampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    m_gBufferMotion                        = m_alloc.createTexture(image, ivInfo, sampler);
+    m_gBufferMotion.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  }
+
+  // Creating the depth buffer, sampled afterwards to reconstruct positions
+  {
+    auto depthCreateInfo = nvvk::makeImage2DCreateInfo(m_size, m_gBufferDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     nvvk::Image image = m_alloc.createImage(depthCreateInfo);
 
     VkImageViewCreateInfo depthStencilView{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
@@ -823,11 +1010,11 @@ void HelloVulkan::createGBufferRender()
     nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
     auto              cmdBuf = genCmdBuf.createCommandBuffer();
     nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferNormals.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferDepthTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferAlbedo.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferDiffuse.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferMotion.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferDepth.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+    nvvk::cmdBarrierImageLayout(cmdBuf, m_gBufferDepth.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_DEPTH_BIT);
     genCmdBuf.submitAndWait(cmdBuf);
   }
 
@@ -838,16 +1025,16 @@ void HelloVulkan::createGBufferRender()
         // Colour Images
         {0, m_gBufferNormalFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
          VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL},
-        {0, m_gBufferDepthTextureFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-         VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL},
         {0, m_gBufferAlbedoFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
          VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL},
         {0, m_gBufferDiffuseFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
          VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL},
+        {0, m_gBufferMotionFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+         VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL},
 
-         // Depth Buffer
+         // Depth Buffer, kept for the passes sampling it
         {0, m_gBufferDepthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_CLEAR,
-         VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}
+         VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL}
     };
     VkAttachmentReference colorRefs[] = {{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
                                          {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
@@ -858,7 +1045,7 @@ void HelloVulkan::createGBufferRender()
 
     VkSubpassDescription subpass    = {};
     subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount    = 4;  // Updated to 4 for the added attachments
+    subpass.colorAttachmentCount    = 4;  // Normals, albedo, diffuse and motion vectors
     subpass.pColorAttachments       = colorRefs;
     subpass.pDepthStencilAttachment = &depthRef;
 
@@ -873,9 +1060,9 @@ void HelloVulkan::createGBufferRender()
 
   // Creating the framebuffer for offscreen
   std::vector<VkImageView> fbAttachments = {m_gBufferNormals.descriptor.imageView, 
-                                            m_gBufferDepthTexture.descriptor.imageView,
                                             m_gBufferAlbedo.descriptor.imageView,
                                             m_gBufferDiffuse.descriptor.imageView,
+                                            m_gBufferMotion.descriptor.imageView,
                                             m_gBufferDepth.descriptor.imageView};
 
   vkDestroyFramebuffer(m_device, m_gBufferFramebuffer, nullptr);
@@ -902,7 +1089,9 @@ void HelloVulkan::gBufferBegin(const VkCommandBuffer& cmdBuf) {
       
       // Drawing all triangles
     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gBufferPipeline);
-    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gBufferPipelineLayout, 0, 1, &m_descSet, 0, nullptr);
+    std::vector<uint32_t> dynamicOffsets = frameDynamicOffsets(false);
+    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gBufferPipelineLayout, 0, 1, &m_descSet,
+                            (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
 
     for(const HelloVulkan::ObjInstance& inst : m_instances) {
         auto& model            = m_objModel[inst.objIndex];
@@ -946,7 +1135,7 @@ void HelloVulkan::createGBufferPipeline()
         {3, 0, VK_FORMAT_R32G32_SFLOAT, static_cast<uint32_t>(offsetof(VertexObj, texCoord))},
     });
 
-    // Define color blend attachment states for the two color attachments
+    // Blend states of the colour attachments after the first, the generator starts with one
     std::array<VkPipelineColorBlendAttachmentState, 3> colorBlendAttachments = {};
     for(auto& blendAttachment : colorBlendAttachments) {
         blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -970,10 +1159,13 @@ void HelloVulkan::createGBufferPipeline()
 
 
     m_globalTextures.push_back(m_gBufferNormals);
-    m_globalTextures.push_back(m_gBufferDepthTexture);
+    m_globalTextures.push_back(m_gBufferDepth);
     m_globalTextures.push_back(m_indirectTexture);
     m_globalTextures.push_back(m_gBufferAlbedo);
     m_globalTextures.push_back(m_gBufferDiffuse);
+    m_globalTextures.push_back(m_gBufferMotion);
+    m_globalTextures.push_back(m_indirectHistoryTextures[0]);
+    m_globalTextures.push_back(m_indirectHistoryTextures[1]);
 }
 
 
@@ -1082,10 +1274,18 @@ void HelloVulkan::createRtDescriptorSet() {
                                    VK_SHADER_STAGE_RAYGEN_BIT_KHR);  // Output image
 
   // Indirect
-  m_rtDescSetLayoutBind.addBinding(RtxBindings::eConstants, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eConstants, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1,
                                    VK_SHADER_STAGE_VERTEX_BIT |VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT); // Constants
   m_rtDescSetLayoutBind.addBinding(RtxBindings::eStatus, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
                                    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Probe Status buffer
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eActiveProbes, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                   VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Active probes and indirect arguments
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eProbeSchedule, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                   VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Probe priorities and ray counts
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eRayDirections, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                   VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Ray direction table
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eSampleTiles, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                   VK_SHADER_STAGE_COMPUTE_BIT);  // Classified sampling tiles and indirect arguments
 
   m_rtDescSetLayoutBind.addBinding(RtxBindings::eStorageImages, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
                                    static_cast<uint32_t>(m_storageImages.size()),
@@ -1099,6 +1299,10 @@ void HelloVulkan::createRtDescriptorSet() {
                                    VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Irradiance image
   m_rtDescSetLayoutBind.addBinding(RtxBindings::eVisibilityImage, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
                                    VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Visibility image
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eOffsetsImage, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+                                   VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Probe offsets image
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eProbeTextures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
+                                   VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);  // Offsets, irradiance and visibility arrays
 
 
   m_rtDescPool      = m_rtDescSetLayoutBind.createPool(m_device);
@@ -1125,7 +1329,7 @@ void HelloVulkan::createRtDescriptorSet() {
   VkDescriptorBufferInfo constantsBufferInfo{};
   constantsBufferInfo.buffer = m_bIndirectConstants.buffer;  // Assuming m_constantsBuffer is a VkBuffer handle for the constants buffer
   constantsBufferInfo.offset = 0;
-  constantsBufferInfo.range  = VK_WHOLE_SIZE;
+  constantsBufferInfo.range  = sizeof(Indirect_gpu_constants);  // Dynamic offset selects the frame slot
 
   
   VkDescriptorBufferInfo statusBufferInfo{};
@@ -1133,6 +1337,11 @@ void HelloVulkan::createRtDescriptorSet() {
   statusBufferInfo.offset = 0;
   statusBufferInfo.range  = VK_WHOLE_SIZE;
 
+  VkDescriptorBufferInfo activeProbesBufferInfo{m_bActiveProbes.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo scheduleBufferInfo{m_bProbeSchedule.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo rayDirectionsBufferInfo{m_bRayDirections.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo sampleTilesBufferInfo{m_bSampleTiles.buffer, 0, VK_WHOLE_SIZE};
+
   // Global Images 2D
   std::vector<VkDescriptorImageInfo> imageInfos(m_storageImages.size());
   m_storageImageViews.resize(m_storageImages.size());
@@ -1164,12 +1373,15 @@ void HelloVulkan::createRtDescriptorSet() {
   m_globalTextureSamplers.resize(m_globalTextures.size());
 
   for(size_t i = 0; i < m_globalTextures.size(); ++i) {
+    // The G-buffer depth is read through its depth aspect, unfiltered: linear filtering of depth formats is optional
+    const bool isDepth = m_globalTextures[i].image == m_gBufferDepth.image;
+
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image                           = m_globalTextures[i].image;
     viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format                          = m_globalTextures[i].format;
-    viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.format                          = isDepth ? m_gBufferDepthFormat : m_globalTextures[i].format;
+    viewInfo.subresourceRange.aspectMask     = isDepth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel   = 0;
     viewInfo.subresourceRange.levelCount     = 1;
     viewInfo.subresourceRange.baseArrayLayer = 0;
@@ -1182,8 +1394,8 @@ void HelloVulkan::createRtDescriptorSet() {
     // Create or reuse a sampler for global textures
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter               = VK_FILTER_LINEAR;
-    samplerInfo.minFilter               = VK_FILTER_LINEAR;
+    samplerInfo.magFilter               = isDepth ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+    samplerInfo.minFilter               = isDepth ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
     samplerInfo.addressModeU            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     samplerInfo.addressModeV            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     samplerInfo.addressModeW            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -1207,9 +1419,11 @@ void HelloVulkan::createRtDescriptorSet() {
     globalTextureInfos[i].sampler     = m_globalTextureSamplers[i];
   }
 
-  // Binded images
+  // Binded images, the array views of the probe atlases
   VkDescriptorImageInfo irradianceImageInfo{{}, m_irradianceTexture.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
   VkDescriptorImageInfo visibilityImageInfo{{}, m_visibilityTexture.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
+  VkDescriptorImageInfo offsetsImageInfo{{}, m_offsetsTexture.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
+  const std::array<VkDescriptorImageInfo, 3> probeTextureInfos{m_offsetsTexture.descriptor, m_irradianceTexture.descriptor, m_visibilityTexture.descriptor};
   
 
   // Writes
@@ -1218,8 +1432,14 @@ void HelloVulkan::createRtDescriptorSet() {
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eOutImage, &imageInfo));
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eConstants, &constantsBufferInfo));
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eStatus, &statusBufferInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eActiveProbes, &activeProbesBufferInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eProbeSchedule, &scheduleBufferInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eRayDirections, &rayDirectionsBufferInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eSampleTiles, &sampleTilesBufferInfo));
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eIrradianceImage, &irradianceImageInfo));
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eVisibilityImage, &visibilityImageInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eOffsetsImage, &offsetsImageInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWriteArray(m_rtDescSet, RtxBindings::eProbeTextures, probeTextureInfos.data()));
   
   // Global Images 2D
   VkWriteDescriptorSet writeStorageImages = {};
@@ -1448,9 +1668,10 @@ void HelloVulkan::raytrace(const VkCommandBuffer& cmdBuf, const glm::vec4& clear
   
 
   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+  std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtPipeline);
   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtPipelineLayout, 0,
-                          (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
+                          (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
   vkCmdPushConstants(cmdBuf, m_rtPipelineLayout,
                      VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
                      0, sizeof(PushConstantRay), &m_pcRay);
@@ -1475,21 +1696,47 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
 
   volume.per_frame_probe_updates = scene.gi_per_frame_probes_update;
   //volume.per_frame_probe_updates = 0;
+  // The radiance and SH textures have a row per probe and the atlases a layer per z slice, the volumes are clamped to fit
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+  volume.create_volumes(scene.gi_extra_volumes, scene.gi_probe_cascades, deviceProperties.limits.maxImageDimension2D,
+                        deviceProperties.limits.maxImageArrayLayers);
   const uint32_t num_probes      = volume.get_total_probes();
   scene.gi_total_probes     = num_probes;
 
-  volume.half_resolution_output = scene.gi_use_half_resolution;
   
   // Create Buffers
   createIndirectConstantsBuffer();
   createIndirectStatusBuffer();
+  createActiveProbesBuffer();
+  createProbeScheduleBuffer();
+  createRayDirectionsBuffer();
+  createSampleTilesBuffer();
+
+
+  // Storage formats
+  // The compact atlases need both formats usable as storage images, the shaders are built for one pair or the other
+  auto storageSupport = [this](VkFormat format) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+    const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+  };
+  volume.compact_atlases = scene.gi_use_compact_atlases && storageSupport(VK_FORMAT_B10G11R11_UFLOAT_PACK32) && storageSupport(VK_FORMAT_R16G16_SFLOAT);
+  if(scene.gi_use_compact_atlases && !volume.compact_atlases) {
+    LOGI("Compact atlas formats can't be used as storage images, falling back to RGBA16F\n");
+  }
+  volume.irradiance_format = volume.compact_atlases ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT;
+  volume.visibility_format = volume.compact_atlases ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
 
 
   // Texture creation
   //-----------------
   // Radiance Texture
+  // One row per probe, wide enough for the largest ray count. A probe only fills the first texels of its row.
   const uint32_t num_rays = volume.probe_rays;
-  auto           radianceCreateInfo = nvvk::makeImage2DCreateInfo({num_rays, num_probes}, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+  auto           radianceCreateInfo = nvvk::makeImage2DCreateInfo({num_rays, num_probes}, volume.radiance_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  setAsyncSharing(radianceCreateInfo);
   m_radianceImage  = m_alloc.createImage(radianceCreateInfo);
   nvvk::cmdBarrierImageLayout(cmdBuf, m_radianceImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
   //m_radianceImage = createStorageImage(cmdBuf, m_device, m_physicalDevice, num_rays, num_probes, VK_FORMAT_R16G16B16A16_SFLOAT);
@@ -1503,12 +1750,34 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
 
 
   //----------------------
-  // Probe offsets texture
-  auto offsetsCreateInfo = nvvk::makeImage2DCreateInfo({volume.probe_count_x * volume.probe_count_y, volume.probe_count_z}, VK_FORMAT_R16G16B16A16_SFLOAT,
-                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
-  m_offsetsImage = createStorageImage(cmdBuf, m_device, m_physicalDevice, volume.probe_count_x * volume.probe_count_y, volume.probe_count_z, VK_FORMAT_R16G16B16A16_SFLOAT);
+  // The offsets texture and both atlases are 2D arrays with one layer per z slice of every volume (get_probe_atlas_tile
+  // in probeUtil.glsl). The probe shaders go through the array views, the global arrays only see layer 0.
+  const int octahedral_irradiance_size = volume.irradiance_probe_size + 2;
+  const int octahedral_visibility_size = volume.visibility_probe_size + 2;
+  const uint32_t atlasSide = glm::max(octahedral_irradiance_size, octahedral_visibility_size) * glm::max(volume.atlas_tile_columns, volume.atlas_tile_rows);
+  if(atlasSide > deviceProperties.limits.maxImageDimension2D || volume.atlas_layers > deviceProperties.limits.maxImageArrayLayers) {
+    LOGE("Probe atlas of %u pixels and %u layers exceeds the device limits (%u pixels, %u layers)\n", atlasSide,
+         volume.atlas_layers, deviceProperties.limits.maxImageDimension2D, deviceProperties.limits.maxImageArrayLayers);
+    throw std::runtime_error("Probe atlas exceeds the image limits of the device");
+  }
+
+  VkSamplerCreateInfo atlasSampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  atlasSampler.magFilter    = VK_FILTER_LINEAR;
+  atlasSampler.minFilter    = VK_FILTER_LINEAR;
+  atlasSampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  atlasSampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  atlasSampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+  // Probe offsets texture, one texel per atlas tile
+  auto offsetsCreateInfo = nvvk::makeImage2DCreateInfo({volume.atlas_tile_columns, volume.atlas_tile_rows}, VK_FORMAT_R16G16B16A16_SFLOAT,
+                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  offsetsCreateInfo.arrayLayers = volume.atlas_layers;
+  setAsyncSharing(offsetsCreateInfo);
+  m_offsetsImage = m_alloc.createImage(offsetsCreateInfo);
+  nvvk::cmdBarrierImageLayout(cmdBuf, m_offsetsImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
   VkImageViewCreateInfo offsetsIvInfo = nvvk::makeImageViewCreateInfo(m_offsetsImage.image, offsetsCreateInfo);
-  VkSamplerCreateInfo offsetsSampler { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+  offsetsIvInfo.viewType              = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  VkSamplerCreateInfo offsetsSampler = atlasSampler;
   m_offsetsTexture                        = m_alloc.createTexture(m_offsetsImage, offsetsIvInfo, offsetsSampler);
   m_offsetsTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
@@ -1518,18 +1787,20 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
 
   //----------------------
   // Irradiance Texture 6x6 plus 2 additional pixel border to allow interpolation
-  const int octahedral_irradiance_size = volume.irradiance_probe_size + 2;
-  volume.irradiance_atlas_width        = (octahedral_irradiance_size * volume.probe_count_x * volume.probe_count_y);
-  volume.irradiance_atlas_height       = (octahedral_irradiance_size * volume.probe_count_z);
+  volume.irradiance_atlas_width        = (octahedral_irradiance_size * volume.atlas_tile_columns);
+  volume.irradiance_atlas_height       = (octahedral_irradiance_size * volume.atlas_tile_rows);
   //m_irradianceImage = createStorageImage(cmdBuf, m_device, m_physicalDevice, irradiance_atlas_width, irradiance_atlas_height, VK_FORMAT_R16G16B16A16_SFLOAT);
   auto irradianceCreateInfo = nvvk::makeImage2DCreateInfo(
       {static_cast<uint32_t>(volume.irradiance_atlas_width), static_cast<uint32_t>(volume.irradiance_atlas_height)},
-      VK_FORMAT_R16G16B16A16_SFLOAT,
-                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+      volume.irradiance_format,
+                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  irradianceCreateInfo.arrayLayers = volume.atlas_layers;
+  setAsyncSharing(irradianceCreateInfo);
   m_irradianceImage = m_alloc.createImage(irradianceCreateInfo);
   nvvk::cmdBarrierImageLayout(cmdBuf, m_irradianceImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
   VkImageViewCreateInfo irradianceIvInfo = nvvk::makeImageViewCreateInfo(m_irradianceImage.image, irradianceCreateInfo);
-  VkSamplerCreateInfo   irradianceSampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  irradianceIvInfo.viewType              = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  VkSamplerCreateInfo   irradianceSampler = atlasSampler;
   m_irradianceTexture                       = m_alloc.createTexture(m_irradianceImage, irradianceIvInfo, irradianceSampler);
   m_irradianceTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
   
@@ -1537,17 +1808,19 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
 
 
   // Visibility Texture
-  const int octahedral_visibility_size     = volume.visibility_probe_size + 2;
-  volume.visibility_atlas_width        = (octahedral_visibility_size * volume.probe_count_x * volume.probe_count_y);
-  volume.visibility_atlas_height           = (octahedral_visibility_size * volume.probe_count_z);
+  volume.visibility_atlas_width        = (octahedral_visibility_size * volume.atlas_tile_columns);
+  volume.visibility_atlas_height           = (octahedral_visibility_size * volume.atlas_tile_rows);
   //m_visibilityImage = createStorageImage(cmdBuf, m_device, m_physicalDevice, visibility_atlas_width, visibility_atlas_height, VK_FORMAT_R16G16_SFLOAT);
   auto visibilityCreateInfo = nvvk::makeImage2DCreateInfo(
       {static_cast<uint32_t>(volume.visibility_atlas_width), static_cast<uint32_t>(volume.visibility_atlas_height)},
-      VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+      volume.visibility_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  visibilityCreateInfo.arrayLayers = volume.atlas_layers;
+  setAsyncSharing(visibilityCreateInfo);
   m_visibilityImage = m_alloc.createImage(visibilityCreateInfo);
   nvvk::cmdBarrierImageLayout(cmdBuf, m_visibilityImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
   VkImageViewCreateInfo visibilityIvInfo = nvvk::makeImageViewCreateInfo(m_visibilityImage.image, visibilityCreateInfo);
-  VkSamplerCreateInfo   visibilitySampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  visibilityIvInfo.viewType              = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  VkSamplerCreateInfo   visibilitySampler = atlasSampler;
   m_visibilityTexture = m_alloc.createTexture(m_visibilityImage, visibilityIvInfo, visibilitySampler);
   m_visibilityTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
@@ -1555,10 +1828,9 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
   
 
   // Indirect Texture
-  uint32_t adjusted_width  = scene.gi_use_half_resolution ? m_size.width / 2 : m_size.width;
-  uint32_t adjusted_height = scene.gi_use_half_resolution ? m_size.height / 2 : m_size.height;
+  // Full resolution, sampled directly at divider 1 and upsampled into otherwise
   //m_indirectImage = createStorageImage(cmdBuf, m_device, m_physicalDevice, adjusted_width, adjusted_height, VK_FORMAT_R16G16B16A16_SFLOAT);
-  auto indirectCreateInfo = nvvk::makeImage2DCreateInfo({adjusted_width, adjusted_height}, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+  auto indirectCreateInfo = nvvk::makeImage2DCreateInfo({m_size.width, m_size.height}, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
   m_indirectImage = m_alloc.createImage(indirectCreateInfo);
 
   nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -1568,19 +1840,128 @@ void HelloVulkan::prepareIndirectComponents(renderSceneVolume& scene) {
   m_indirectTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
   
   m_storageImages.push_back(m_indirectTexture);  // Global Images array
-}
 
 
+  // Probe SH Texture
+  // Always RGBA16F: it is read and written through the global images array
+  auto probeSHCreateInfo = nvvk::makeImage2DCreateInfo({PROBE_SH_COEFFICIENTS, num_probes}, volume.sh_format,
+                                                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  setAsyncSharing(probeSHCreateInfo);
+  m_probeSHImage = m_alloc.createImage(probeSHCreateInfo);
+  nvvk::cmdBarrierImageLayout(cmdBuf, m_probeSHImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+  VkImageViewCreateInfo probeSHIvInfo = nvvk::makeImageViewCreateInfo(m_probeSHImage.image, probeSHCreateInfo);
+  VkSamplerCreateInfo   probeSHSampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  m_probeSHTexture = m_alloc.createTexture(m_probeSHImage, probeSHIvInfo, probeSHSampler);
+  m_probeSHTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  m_storageImages.push_back(m_probeSHTexture);  // Global Images array
+
+
+  // Low Resolution Indirect Texture
+  // Irradiance at 1/2 or 1/4 resolution, alpha is the pixel of its block it was sampled at. Sized for the largest, 1/2.
+  auto indirectLowResCreateInfo = nvvk::makeImage2DCreateInfo({(m_size.width + 1) / 2, (m_size.height + 1) / 2}, VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                              VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  m_indirectLowResImage = m_alloc.createImage(indirectLowResCreateInfo);
+  nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectLowResImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+  VkImageViewCreateInfo indirectLowResIvInfo = nvvk::makeImageViewCreateInfo(m_indirectLowResImage.image, indirectLowResCreateInfo);
+  VkSamplerCreateInfo   indirectLowResSampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  m_indirectLowResTexture = m_alloc.createTexture(m_indirectLowResImage, indirectLowResIvInfo, indirectLowResSampler);
+  m_indirectLowResTexture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  m_storageImages.push_back(m_indirectLowResTexture);  // Global Images array
+
+
+  // Temporal History Textures
+  // Accumulated irradiance and the guide it was accumulated with, a pair of each swapped every frame.
+  // Both histories are also global textures, post reads whichever was written last (createGBufferPipeline).
+  auto historyCreateInfo = nvvk::makeImage2DCreateInfo({m_size.width, m_size.height}, VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  VkSamplerCreateInfo historySampler{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  for(size_t i = 0; i < m_indirectHistoryImages.size(); ++i) {
+    m_indirectHistoryImages[i] = m_alloc.createImage(historyCreateInfo);
+    nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectHistoryImages[i].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    VkImageViewCreateInfo historyIvInfo = nvvk::makeImageViewCreateInfo(m_indirectHistoryImages[i].image, historyCreateInfo);
+    m_indirectHistoryTextures[i] = m_alloc.createTexture(m_indirectHistoryImages[i], historyIvInfo, historySampler);
+    m_indirectHistoryTextures[i].descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    m_indirectGuideImages[i] = m_alloc.createImage(historyCreateInfo);
+    nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectGuideImages[i].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    VkImageViewCreateInfo guideIvInfo = nvvk::makeImageViewCreateInfo(m_indirectGuideImages[i].image, historyCreateInfo);
+    m_indirectGuideTextures[i] = m_alloc.createTexture(m_indirectGuideImages[i], guideIvInfo, historySampler);
+    m_indirectGuideTextures[i].descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  }
+
+  m_storageImages.push_back(m_indirectHistoryTextures[0]);  // Global Images array
+  m_storageImages.push_back(m_indirectHistoryTextures[1]);
+  m_storageImages.push_back(m_indirectGuideTextures[0]);
+  m_storageImages.push_back(m_indirectGuideTextures[1]);
+
+
+  // Start every probe from a known state: the frame loop only records memory barriers and never
+  // discards the contents of these images again
+  const std::array<VkImage, 11> probeImages{m_radianceImage.image,          m_offsetsImage.image,           m_irradianceImage.image,
+                                            m_visibilityImage.image,        m_indirectImage.image,          m_probeSHImage.image,
+                                            m_indirectLowResImage.image,    m_indirectHistoryImages[0].image, m_indirectHistoryImages[1].image,
+                                            m_indirectGuideImages[0].image, m_indirectGuideImages[1].image};
+  Gpu_Barriers barriers;
+  for(VkImage image : probeImages) {
+    barriers.image(image, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  }
+  barriers.flush(cmdBuf);
+
+  VkClearColorValue       clearValue{{0.0f, 0.0f, 0.0f, 0.0f}};
+  VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS};
+  for(VkImage image : probeImages) {
+    vkCmdClearColorImage(cmdBuf, image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &range);
+  }
+  vkCmdFillBuffer(cmdBuf, m_bIndirectStatus.buffer, 0, VK_WHOLE_SIZE, 0);
+  vkCmdFillBuffer(cmdBuf, m_bProbeSchedule.buffer, 0, VK_WHOLE_SIZE, 0);
+
+  cmdBufGet.submitAndWait(cmdBuf);
+  m_alloc.finalizeAndReleaseStaging();
+}
 
 
-void HelloVulkan::IndirectBegin(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor, renderSceneVolume& scene) {
-  m_debug.beginLabel(cmdBuf, "Indirect Begin");
 
-  vkCmdResetQueryPool(cmdBuf, queryPool, 0, 7);
 
-  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 0);
+//--------------------------------------------------------------------------------------------------
+// Every resource shared between passes, imported into the frame graph each frame.
+// Probe data is persistent: it is blended over many frames, so its writers are never culled.
+//
+void HelloVulkan::importGraphResources(Frame_Graph& graph) {
+  m_graphResources.gBufferNormals = graph.import_image("GBuffer Normals", m_gBufferNormals.image);
+  m_graphResources.gBufferDepth   = graph.import_image("GBuffer Depth", m_gBufferDepth.image, false, VK_IMAGE_ASPECT_DEPTH_BIT);
+  m_graphResources.gBufferAlbedo  = graph.import_image("GBuffer Albedo", m_gBufferAlbedo.image);
+  m_graphResources.gBufferDiffuse = graph.import_image("GBuffer Diffuse", m_gBufferDiffuse.image);
+  m_graphResources.gBufferMotion  = graph.import_image("GBuffer Motion", m_gBufferMotion.image);
+
+  m_graphResources.radiance   = graph.import_image("Radiance", m_radianceTexture.image);
+  m_graphResources.offsets    = graph.import_image("Probe Offsets", m_offsetsTexture.image, true);
+  m_graphResources.status     = graph.import_buffer("Probe Status", m_bIndirectStatus.buffer, true);
+  m_graphResources.activeProbes = graph.import_buffer("Active Probes", m_bActiveProbes.buffer);
+  m_graphResources.schedule     = graph.import_buffer("Probe Schedule", m_bProbeSchedule.buffer, true);
+  m_graphResources.rayDirections = graph.import_buffer("Ray Directions", m_bRayDirections.buffer);
+  m_graphResources.sampleTiles   = graph.import_buffer("Sample Tiles", m_bSampleTiles.buffer);
+  m_graphResources.irradiance = graph.import_image("Irradiance Atlas", m_irradianceTexture.image, true);
+  m_graphResources.visibility = graph.import_image("Visibility Atlas", m_visibilityTexture.image, true);
+  m_graphResources.probeSH    = graph.import_image("Probe SH", m_probeSHTexture.image, true);
+  m_graphResources.indirect   = graph.import_image("Indirect", m_indirectTexture.image);
+  m_graphResources.indirectLowRes = graph.import_image("Indirect Low Res", m_indirectLowResTexture.image);
+  m_graphResources.indirectHistory[0] = graph.import_image("Indirect History 0", m_indirectHistoryTextures[0].image, true);
+  m_graphResources.indirectHistory[1] = graph.import_image("Indirect History 1", m_indirectHistoryTextures[1].image, true);
+  m_graphResources.indirectGuide[0]   = graph.import_image("Indirect Guide 0", m_indirectGuideTextures[0].image, true);
+  m_graphResources.indirectGuide[1]   = graph.import_image("Indirect Guide 1", m_indirectGuideTextures[1].image, true);
+
+  m_graphResources.offscreenColor = graph.import_image("Offscreen Color", m_offscreenColor.image);
+  m_graphResources.debugColor     = graph.import_image("Debug Color", m_debugTexture.image);
+}
 
 
+//--------------------------------------------------------------------------------------------------
+// Declares the GI chain: probe trace, offsets, status, irradiance/visibility blending and sampling.
+// Barriers between the passes come from the frame graph.
+//
+void HelloVulkan::addIndirectPasses(Frame_Graph& graph, const glm::vec4& clearColor, renderSceneVolume& scene) {
   // Initializing push constant values
   m_pcRay.clearColor     = clearColor;
   m_pcRay.lightPosition  = m_pcRaster.lightPosition;
@@ -1588,217 +1969,519 @@ void HelloVulkan::IndirectBegin(const VkCommandBuffer& cmdBuf, const glm::vec4&
   m_pcRay.lightType      = m_pcRaster.lightType;
 
   // Sample Irradiance Push Constant
-  m_pcSampleIrradiance.output_resolution_half = (scene.gi_use_half_resolution == true) ? 1 : 0;
+  m_pcSampleIrradiance.resolution_divider = scene.gi_resolution_divider >= 4 ? 4 : (scene.gi_resolution_divider >= 2 ? 2 : 1);
 
-  uint32_t   first_frame;
-  static int offsets_calculations_count = 24;
-
-  if(scene.gi_recalculate_offsets) {
-    offsets_calculations_count = 24;
+  // Temporal accumulation, restarted whenever a frame went by without it
+  const bool temporal = scene.gi_use_temporal;
+  if(temporal) {
+    m_pcIndirectTemporal.reset = m_lastAccumulatedFrame + 1 != m_temporalFrame ? 1 : 0;
+    m_lastAccumulatedFrame     = m_temporalFrame;
   }
 
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_radianceTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-    genCmdBuf.submitAndWait(cmdBuf);
+  // While accumulating, each frame samples another pixel of every block, in ordered dither order so that
+  // consecutive frames land far apart: after divider x divider frames every pixel was sampled once
+  m_pcSampleIrradiance.sample_rotation = -1;
+  if(temporal && m_pcSampleIrradiance.resolution_divider > 1) {
+    const uint32_t divider = m_pcSampleIrradiance.resolution_divider;
+    uint32_t       rank    = m_temporalFrame % (divider * divider);
+    glm::uvec2     pixel{0};
+    for(uint32_t step = divider / 2; step >= 1; step /= 2, rank >>= 2) {
+      const uint32_t quadrant = rank & 3;
+      pixel += step * glm::uvec2((quadrant ^ (quadrant >> 1)) & 1, quadrant & 1);
+    }
+    m_pcSampleIrradiance.sample_rotation = int(pixel.y * divider + pixel.x);
   }
 
-  // Ray Tracing
-  std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_IndirectPipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_IndirectPipelineLayout, 0,
-                          (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  vkCmdPushConstants(cmdBuf, m_IndirectPipelineLayout,
-                     VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
-                     0, sizeof(PushConstantRay), &m_pcRay);
-  const uint32_t probe_count = offsets_calculations_count >= 0 ? volume.get_total_probes() : volume.per_frame_probe_updates;
-  //const uint32_t probe_count = volume.get_total_probes();
-  vkCmdTraceRaysKHR(cmdBuf, &m_IndirectRgenRegion, &m_IndirectMissRegion, &m_IndirectHitRegion, &m_IndirectCallRegion,
-                    volume.probe_rays, volume.get_total_probes(), 1);
-
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_radianceTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-    genCmdBuf.submitAndWait(cmdBuf);
+  // Every probe pass covers the probes picked by the scheduling pass, the whole grid while placing the offsets
+  const bool update_offsets = volume.offsets_calculations_count >= 0;
+
+  // The probe update chain goes to the compute queue when there is one
+  const Frame_Graph::Queue chainQueue = m_asyncCompute ? Frame_Graph::QUEUE_ASYNC_COMPUTE : Frame_Graph::QUEUE_GRAPHICS;
+
+  const GraphResources&      res     = m_graphResources;
+  const VkPipelineStageFlags rtStage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+  const VkPipelineStageFlags csStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  const VkAccessFlags        read    = VK_ACCESS_SHADER_READ_BIT;
+  const VkAccessFlags        write   = VK_ACCESS_SHADER_WRITE_BIT;
+
+  // Indirect arguments are read before the shaders of the pass
+  const VkPipelineStageFlags argsStage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+  const VkAccessFlags        argsRead  = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+
+  // Probe Scroll
+  // Only on frames where a volume moved: the probes it exposed take over the slots of the ones it left behind
+  if(volume.volumes_scrolled) {
+    graph.add_pass("Probe Scroll", {{res.status, csStage, read}, {res.schedule, csStage, read}, {res.offsets, csStage, read}},
+                   {{res.status, csStage, write}, {res.schedule, csStage, write}, {res.offsets, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Scroll Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeScrollPipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeScrollPipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_probeScrollPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantSchedule), &m_pcProbeSchedule);
+                     m_probeScrollPipeline.dispatch_for_extent(cmdBuf, volume.get_total_probes());
+                     m_debug.endLabel(cmdBuf);
+                   });
   }
 
-  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 1);
-  
-  m_debug.endLabel(cmdBuf);
-  
-
 
-  
-  if(offsets_calculations_count >= 0) {
-    --offsets_calculations_count;
-    first_frame = offsets_calculations_count == 23 ? 1 : 0;
-
-    m_pcProbeOffsets.first_frame = first_frame;
+  // Probe Scheduling
+  // Ranks every probe, fills the update budget from the highest priority down and packs the picked probes.
+  // The indirect arguments of every following probe pass come out of it.
+  m_pcProbeSchedule.keep_all = update_offsets ? 1 : 0;
+  graph.add_pass("Probe Schedule", {{res.status, csStage, read}, {res.schedule, csStage, read}},
+                 {{res.schedule, csStage, write}, {res.activeProbes, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Schedule Compute Begin");
+
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   auto dispatch = [&](const Compute_Pipeline& pipeline, uint32_t threads) {
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, (uint32_t)descSets.size(),
+                                             descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantSchedule), &m_pcProbeSchedule);
+                     pipeline.dispatch_for_extent(cmdBuf, threads);
+                   };
+
+                   // Every step reads what the previous one wrote
+                   auto dependency = [&]() {
+                     const VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                     Gpu_Barriers        barriers;
+                     barriers.buffer(m_bProbeSchedule.buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, access,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, access);
+                     barriers.buffer(m_bActiveProbes.buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, access,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, access);
+                     barriers.flush(cmdBuf);
+                   };
+
+                   const uint32_t probes = volume.get_total_probes();
+                   dispatch(m_probePriorityPipeline, probes);
+                   dependency();
+                   dispatch(m_probeThresholdPipeline, 1);
+                   dependency();
+                   dispatch(m_probeCompactPipeline, probes);
+                   m_debug.endLabel(cmdBuf);
+                 });
+
+
+  // Ray Directions
+  // Rotated once per frame for every ray count, the trace and every probe pass after it read them back
+  graph.add_pass("Probe Directions", {}, {{res.rayDirections, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Directions Compute Begin");
+
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeDirectionsPipeline.pipeline);
+                   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeDirectionsPipeline.layout, 0,
+                                           (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                   m_probeDirectionsPipeline.dispatch_for_extent(cmdBuf, PROBE_RAY_TABLE_SIZE);
+                   m_debug.endLabel(cmdBuf);
+                 });
 
-    m_debug.beginLabel(cmdBuf, "Offsets Compute Begin");
 
-    {
-      nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-      auto              cmdBuf = genCmdBuf.createCommandBuffer();
-      nvvk::cmdBarrierImageLayout(cmdBuf, m_offsetsTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-      genCmdBuf.submitAndWait(cmdBuf);
+  // Ray Tracing
+  graph.add_pass("Probe Trace",
+                 {{res.offsets, rtStage, read}, {res.activeProbes, rtStage | argsStage, read | argsRead}, {res.schedule, rtStage, read}, {res.rayDirections, rtStage, read},
+                  {res.irradiance, rtStage, read}, {res.visibility, rtStage, read}, {res.probeSH, rtStage, read}},
+                 {{res.radiance, rtStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Indirect Begin");
+
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_IndirectPipeline);
+                   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_IndirectPipelineLayout, 0,
+                                           (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                   vkCmdPushConstants(cmdBuf, m_IndirectPipelineLayout,
+                                      VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
+                                      0, sizeof(PushConstantRay), &m_pcRay);
+                   vkCmdTraceRaysIndirectKHR(cmdBuf, &m_IndirectRgenRegion, &m_IndirectMissRegion, &m_IndirectHitRegion,
+                                             &m_IndirectCallRegion, m_activeProbesAddress);
+                   m_debug.endLabel(cmdBuf);
+                 });
+
+
+  // Probe Offsets, over the whole grid while it is being (re)placed, otherwise over the probes exposed by a scroll
+  {
+    if(update_offsets) {
+      --volume.offsets_calculations_count;
     }
-
-    // Probe Offsets Compute Pipeline
-    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeOffsetsPipeline);
-    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeOffsetsPipelineLayout, 0,
-                            (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-    vkCmdPushConstants(cmdBuf, m_probeOffsetsPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantOffset),
-                       &m_pcProbeOffsets);
-    vkCmdDispatch(cmdBuf, glm::ceil(probe_count / 32.0f), 1, 1);
-
-      vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 2);
-
-
-    m_debug.endLabel(cmdBuf);
+    m_pcProbeOffsets.first_frame = volume.offsets_calculations_count == PROBE_RELOCATION_FRAMES - 1 ? 1 : 0;
+    m_pcProbeOffsets.update_all  = update_offsets ? 1 : 0;
+
+    graph.add_pass("Probe Offsets",
+                   {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                    {res.offsets, csStage, read}},
+                   {{res.offsets, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Offsets Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeOffsetsPipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeOffsetsPipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_probeOffsetsPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantOffset), &m_pcProbeOffsets);
+                     vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, probe_x));
+                     m_debug.endLabel(cmdBuf);
+                   }, false, chainQueue);
   }
 
 
-
-
-
-  m_debug.beginLabel(cmdBuf, "Status Compute Begin");
-
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_radianceTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-    genCmdBuf.submitAndWait(cmdBuf);
+  // Probe Status
+  m_pcProbeStatus.first_frame = 0;
+  graph.add_pass("Probe Status",
+                 {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                  {res.status, csStage, read}},
+                 {{res.status, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Status Compute Begin");
+
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeStatusPipeline.pipeline);
+                   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeStatusPipeline.layout, 0,
+                                           (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                   vkCmdPushConstants(cmdBuf, m_probeStatusPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                      sizeof(PushConstantStatus), &m_pcProbeStatus);
+                   vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, probe_x));
+                   m_debug.endLabel(cmdBuf);
+                 }, false, chainQueue);
+
+
+  // Probe Update
+  // The fused pass reads each ray once for both atlases, the two pass path is kept to compare timings.
+  // Fusing needs both atlases to share the probe layout. In SH mode irradiance is projected by its own pass instead.
+  const bool sh_irradiance = scene.gi_use_sh_irradiance;
+  const bool fused_blend   = !sh_irradiance && scene.gi_use_fused_blend && volume.irradiance_probe_size == volume.visibility_probe_size;
+  if(fused_blend) {
+    graph.add_pass("Probe Blend",
+                   {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                    {res.irradiance, csStage, read}, {res.visibility, csStage, read}},
+                   {{res.irradiance, csStage, write}, {res.visibility, csStage, write}, {res.schedule, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Blend Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateFusedPipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateFusedPipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_probeUpdateFusedPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantOffset), &m_pcProbeOffsets);
+                     vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, blend_x));
+                     m_debug.endLabel(cmdBuf);
+                   }, false, chainQueue);
   }
+  else {
+    if(sh_irradiance) {
+      // Probe Update SH
+      graph.add_pass("Probe SH",
+                     {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                      {res.probeSH, csStage, read}},
+                     {{res.probeSH, csStage, write}, {res.schedule, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                       m_debug.beginLabel(cmdBuf, "SH Compute Begin");
+
+                       std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                       std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                       vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateSHPipeline.pipeline);
+                       vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateSHPipeline.layout, 0,
+                                               (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                       vkCmdPushConstants(cmdBuf, m_probeUpdateSHPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                          sizeof(PushConstantOffset), &m_pcProbeOffsets);
+                       vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, blend_x));
+                       m_debug.endLabel(cmdBuf);
+                     }, false, chainQueue);
+    }
+    else {
+      // Probe Update Irradiance
+      graph.add_pass("Probe Irradiance",
+                     {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                      {res.irradiance, csStage, read}},
+                     {{res.irradiance, csStage, write}, {res.schedule, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                       m_debug.beginLabel(cmdBuf, "Irradiance Compute Begin");
+
+                       std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                       std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                       vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateIrradiancePipeline.pipeline);
+                       vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateIrradiancePipeline.layout, 0,
+                                               (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                       vkCmdPushConstants(cmdBuf, m_probeUpdateIrradiancePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                          sizeof(PushConstantOffset), &m_pcProbeOffsets);
+                       vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, blend_x));
+                       m_debug.endLabel(cmdBuf);
+                     }, false, chainQueue);
+    }
 
-  // Probe Status
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeStatusPipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeStatusPipelineLayout, 0,
-                          (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  first_frame = 0;
-  m_pcProbeStatus.first_frame = first_frame;
-  vkCmdPushConstants(cmdBuf, m_probeStatusPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantStatus), &m_pcProbeStatus);
-  vkCmdDispatch(cmdBuf, glm::ceil(probe_count / 32.0f), 1, 1);
 
+    // Probe Update Visibility
+    graph.add_pass("Probe Visibility",
+                   {{res.radiance, csStage, read}, {res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.rayDirections, csStage, read},
+                    {res.visibility, csStage, read}},
+                   {{res.visibility, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Visibility Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateVisibilityPipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateVisibilityPipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_probeUpdateVisibilityPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantOffset), &m_pcProbeOffsets);
+                     vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, blend_x));
+                     m_debug.endLabel(cmdBuf);
+                   }, false, chainQueue);
+  }
 
-    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 3);
-  m_debug.endLabel(cmdBuf);
 
+  // Probe Border
+  // Border texels of the probes blended this frame, a workgroup per active probe walking both atlases.
+  // Also the last pass to read their relocation countdown, which it steps.
+  graph.add_pass("Probe Border",
+                 {{res.activeProbes, csStage | argsStage, read | argsRead}, {res.schedule, csStage, read}, {res.irradiance, csStage, read}, {res.visibility, csStage, read}},
+                 {{res.irradiance, csStage, write}, {res.visibility, csStage, write}, {res.schedule, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Border Compute Begin");
 
-  m_debug.beginLabel(cmdBuf, "Irradiance Compute Begin");
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeBorderPipeline.pipeline);
+                   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeBorderPipeline.layout, 0,
+                                           (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                   vkCmdDispatchIndirect(cmdBuf, m_bActiveProbes.buffer, offsetof(ProbeIndirectArgs, blend_x));
+                   m_debug.endLabel(cmdBuf);
+                 }, false, chainQueue);
 
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_irradianceTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
-    genCmdBuf.submitAndWait(cmdBuf);
+  // Sample Irradiance
+  // Once per divider x divider block of pixels, straight into the indirect image at full resolution.
+  // With tile classification the tiles are first sorted: sky tiles are written by the classification and cost nothing
+  // more, tiles inside one probe cell share their cage through shared memory, the rest sample every volume per pixel.
+  const uint32_t resolution_divider = m_pcSampleIrradiance.resolution_divider;
+  const bool     upsample           = resolution_divider > 1;
+  const uint32_t sampleWidth        = (m_size.width + resolution_divider - 1) / resolution_divider;
+  const uint32_t sampleHeight       = (m_size.height + resolution_divider - 1) / resolution_divider;
+  const bool     classify           = scene.gi_use_sample_tiles;
+  m_pcSampleIrradiance.tile_list    = classify ? 1 : 0;
+
+  std::vector<Frame_Graph::Access> sampleReads{{res.gBufferNormals, csStage, read}, {res.gBufferDepth, csStage, read},
+                                               {res.offsets, csStage, read},        {res.status, csStage, read},
+                                               {res.irradiance, csStage, read},     {res.visibility, csStage, read},
+                                               {res.probeSH, csStage, read}};
+  std::vector<Frame_Graph::Access> sampleWrites{{upsample ? res.indirectLowRes : res.indirect, csStage, write}};
+  if(classify) {
+    // Reset with a transfer, filled by the classification, read back as indirect arguments
+    sampleReads.push_back({res.sampleTiles, csStage | argsStage, read | argsRead});
+    sampleWrites.push_back({res.sampleTiles, VK_PIPELINE_STAGE_TRANSFER_BIT | csStage, VK_ACCESS_TRANSFER_WRITE_BIT | write});
   }
 
-  // Probe Update Irradiance
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateIrradiancePipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateIrradiancePipelineLayout, 0, (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  vkCmdPushConstants(cmdBuf, m_probeUpdateIrradiancePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-                     sizeof(PushConstantOffset), &m_pcProbeOffsets);
-  vkCmdDispatch(cmdBuf, glm::ceil(volume.irradiance_atlas_width / 8.0f), glm::ceil(volume.irradiance_atlas_height / 8.0f), 1);
-  
-    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 4);
-  
-  m_debug.endLabel(cmdBuf);
-
-
+  graph.add_pass("Sample Irradiance", sampleReads, sampleWrites, [this, sampleWidth, sampleHeight, classify](VkCommandBuffer cmdBuf) {
+                   m_debug.beginLabel(cmdBuf, "Sample Compute Begin");
+
+                   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                   std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                   auto bind = [&](const Compute_Pipeline& pipeline) {
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, (uint32_t)descSets.size(),
+                                             descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantSample), &m_pcSampleIrradiance);
+                   };
+
+                   // One workgroup per tile, the tile lists count in the same units
+                   if(!classify) {
+                     bind(m_sampleIrradiancePipeline);
+                     m_sampleIrradiancePipeline.dispatch_for_extent(cmdBuf, sampleWidth, sampleHeight);
+                     m_debug.endLabel(cmdBuf);
+                     return;
+                   }
+
+                   const SampleTileArgs emptyArgs{0, 1, 1, 0, 1, 1, 0, m_sampleTileCapacity};
+                   vkCmdUpdateBuffer(cmdBuf, m_bSampleTiles.buffer, 0, sizeof(SampleTileArgs), &emptyArgs);
+
+                   Gpu_Barriers reset;
+                   reset.buffer(m_bSampleTiles.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+                   reset.flush(cmdBuf);
+
+                   bind(m_sampleClassifyPipeline);
+                   m_sampleClassifyPipeline.dispatch_for_extent(cmdBuf, sampleWidth, sampleHeight);
+
+                   Gpu_Barriers classified;
+                   classified.buffer(m_bSampleTiles.buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+                   classified.flush(cmdBuf);
+
+                   bind(m_sampleCoherentPipeline);
+                   vkCmdDispatchIndirect(cmdBuf, m_bSampleTiles.buffer, offsetof(SampleTileArgs, coherent_x));
+                   bind(m_sampleIrradiancePipeline);
+                   vkCmdDispatchIndirect(cmdBuf, m_bSampleTiles.buffer, offsetof(SampleTileArgs, mixed_x));
+                   m_debug.endLabel(cmdBuf);
+                 });
+
+
+  // Indirect Upsample
+  // Joint bilateral, guided by the full resolution depth and normals
+  if(upsample) {
+    graph.add_pass("Indirect Upsample",
+                   {{res.gBufferNormals, csStage, read}, {res.gBufferDepth, csStage, read}, {res.indirectLowRes, csStage, read}},
+                   {{res.indirect, csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Upsample Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_indirectUpsamplePipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_indirectUpsamplePipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_indirectUpsamplePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantSample), &m_pcSampleIrradiance);
+                     m_indirectUpsamplePipeline.dispatch_for_extent(cmdBuf, m_size.width, m_size.height);
+                     m_debug.endLabel(cmdBuf);
+                   });
+  }
 
 
+  // Indirect Temporal
+  // Last frame's accumulation reprojected with the motion vectors, rejected where depth or normal changed.
+  // Post reads the history written here instead of the indirect image.
+  if(temporal) {
+    const uint32_t output = getTemporalOutput();
+    graph.add_pass("Indirect Temporal",
+                   {{res.gBufferNormals, csStage, read}, {res.gBufferDepth, csStage, read}, {res.gBufferMotion, csStage, read},
+                    {res.indirect, csStage, read}, {res.indirectHistory[output ^ 1], csStage, read}, {res.indirectGuide[output ^ 1], csStage, read}},
+                   {{res.indirectHistory[output], csStage, write}, {res.indirectGuide[output], csStage, write}}, [this](VkCommandBuffer cmdBuf) {
+                     m_debug.beginLabel(cmdBuf, "Temporal Compute Begin");
+
+                     std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+                     std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
+                     vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_indirectTemporalPipeline.pipeline);
+                     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_indirectTemporalPipeline.layout, 0,
+                                             (uint32_t)descSets.size(), descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+                     vkCmdPushConstants(cmdBuf, m_indirectTemporalPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(PushConstantTemporal), &m_pcIndirectTemporal);
+                     m_indirectTemporalPipeline.dispatch_for_extent(cmdBuf, m_size.width, m_size.height);
+                     m_debug.endLabel(cmdBuf);
+                   });
+  }
+}
 
-  m_debug.beginLabel(cmdBuf, "Visibility Compute Begin");
 
-  // Probe Update Visibility
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_visibilityTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
-    genCmdBuf.submitAndWait(cmdBuf);
+//--------------------------------------------------------------------------------------------------
+// Async compute: the probe update chain runs on its own queue, overlapping the G-Buffer and main passes.
+// Each frame is submitted as trace -> compute -> main, chained with one semaphore per hand-off.
+//
+void HelloVulkan::initAsyncCompute(VkQueue computeQueue, uint32_t computeQueueFamily) {
+  m_asyncCompute          = true;
+  m_computeQueue          = computeQueue;
+  m_asyncQueueFamilies[0] = m_graphicsQueueIndex;
+  m_asyncQueueFamilies[1] = computeQueueFamily;
+
+  VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = computeQueueFamily;
+  vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_computeCmdPool);
+
+  const uint32_t frameCount = m_swapChain.getImageCount();
+  m_asyncFrames.resize(frameCount);
+  for(AsyncFrame& frame : m_asyncFrames) {
+    VkCommandBufferAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocateInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    allocateInfo.commandPool        = m_cmdPool;
+    vkAllocateCommandBuffers(m_device, &allocateInfo, &frame.traceCmdBuf);
+    allocateInfo.commandPool = m_computeCmdPool;
+    vkAllocateCommandBuffers(m_device, &allocateInfo, &frame.computeCmdBuf);
+
+    VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.traceDone);
+    vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.computeDone);
+
+    m_debug.setObjectName(frame.computeCmdBuf, "Async Compute");
   }
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateVisibilityPipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_probeUpdateVisibilityPipelineLayout, 0, (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  vkCmdPushConstants(cmdBuf, m_probeUpdateVisibilityPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-                     sizeof(PushConstantOffset), &m_pcProbeOffsets);
-  vkCmdDispatch(cmdBuf, glm::ceil(volume.visibility_atlas_width / 8.0f), glm::ceil(volume.visibility_atlas_height / 8.0f), 1);
-  
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_irradianceTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_visibilityTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+}
 
-    genCmdBuf.submitAndWait(cmdBuf);
+//--------------------------------------------------------------------------------------------------
+// Resources used by both queues are shared concurrently, so no ownership transfers are needed.
+// Nothing to do when both queues belong to the same family.
+//
+void HelloVulkan::setAsyncSharing(VkImageCreateInfo& createInfo) {
+  if(m_asyncCompute && m_asyncQueueFamilies[0] != m_asyncQueueFamilies[1]) {
+    createInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_asyncQueueFamilies.size());
+    createInfo.pQueueFamilyIndices   = m_asyncQueueFamilies.data();
   }
-    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 5);
-
-  m_debug.endLabel(cmdBuf);
-  
-
-
-  m_debug.beginLabel(cmdBuf, "Sample Compute Begin");
- 
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+}
 
-    genCmdBuf.submitAndWait(cmdBuf);
+void HelloVulkan::setAsyncSharing(VkBufferCreateInfo& createInfo) {
+  if(m_asyncCompute && m_asyncQueueFamilies[0] != m_asyncQueueFamilies[1]) {
+    createInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_asyncQueueFamilies.size());
+    createInfo.pQueueFamilyIndices   = m_asyncQueueFamilies.data();
   }
-  const float resolution_divider = scene.gi_use_half_resolution ? 0.5f : 1.0f;
-
+}
 
-  // Sample Irradiance
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_sampleIrradiancePipeline);
-  vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_sampleIrradiancePipelineLayout, 0, (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  vkCmdPushConstants(cmdBuf, m_sampleIrradiancePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantSample), &m_pcSampleIrradiance);
-  vkCmdDispatch(cmdBuf, m_size.width * resolution_divider, m_size.height * resolution_divider, 1);
-  
-  {
-    nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
-    auto              cmdBuf = genCmdBuf.createCommandBuffer();
-    nvvk::cmdBarrierImageLayout(cmdBuf, m_indirectTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+//--------------------------------------------------------------------------------------------------
+// Same as AppBaseVk::submitFrame, with the trace and compute batches in front.
+// Batches wait on each other at the Frame_Graph::queue_handoff_stage (indirect arguments and compute);
+// everything reading the probes later is chained to it by the frame graph barriers.
+//
+void HelloVulkan::submitAsyncFrame() {
+  const uint32_t    imageIndex = m_swapChain.getActiveImageIndex();
+  const AsyncFrame& frame      = m_asyncFrames[imageIndex];
+  VkFence           fence      = m_waitFences[imageIndex];
+  vkResetFences(m_device, 1, &fence);
+
+  // Probe trace
+  VkSubmitInfo traceSubmit{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  traceSubmit.commandBufferCount   = 1;
+  traceSubmit.pCommandBuffers      = &frame.traceCmdBuf;
+  traceSubmit.signalSemaphoreCount = 1;
+  traceSubmit.pSignalSemaphores    = &frame.traceDone;
+  vkQueueSubmit(m_queue, 1, &traceSubmit, VK_NULL_HANDLE);
+
+  // Probe update chain
+  const VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  VkSubmitInfo               computeSubmit{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  computeSubmit.waitSemaphoreCount   = 1;
+  computeSubmit.pWaitSemaphores      = &frame.traceDone;
+  computeSubmit.pWaitDstStageMask    = &computeWaitStage;
+  computeSubmit.commandBufferCount   = 1;
+  computeSubmit.pCommandBuffers      = &frame.computeCmdBuf;
+  computeSubmit.signalSemaphoreCount = 1;
+  computeSubmit.pSignalSemaphores    = &frame.computeDone;
+  vkQueueSubmit(m_computeQueue, 1, &computeSubmit, VK_NULL_HANDLE);
+
+  // Rest of the frame
+  const std::array<VkSemaphore, 2>          waitSemaphores{m_swapChain.getActiveReadSemaphore(), frame.computeDone};
+  const std::array<VkPipelineStageFlags, 2> waitStages{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+  VkSemaphore                               semaphoreWrite = m_swapChain.getActiveWrittenSemaphore();
+
+  VkSubmitInfo mainSubmit{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  mainSubmit.waitSemaphoreCount   = static_cast<uint32_t>(waitSemaphores.size());
+  mainSubmit.pWaitSemaphores      = waitSemaphores.data();
+  mainSubmit.pWaitDstStageMask    = waitStages.data();
+  mainSubmit.commandBufferCount   = 1;
+  mainSubmit.pCommandBuffers      = &m_commandBuffers[imageIndex];
+  mainSubmit.signalSemaphoreCount = 1;
+  mainSubmit.pSignalSemaphores    = &semaphoreWrite;
+  vkQueueSubmit(m_queue, 1, &mainSubmit, fence);
+
+  m_swapChain.present(m_queue);
+}
 
-    genCmdBuf.submitAndWait(cmdBuf);
+void HelloVulkan::destroyAsyncCompute() {
+  for(AsyncFrame& frame : m_asyncFrames) {
+    vkFreeCommandBuffers(m_device, m_cmdPool, 1, &frame.traceCmdBuf);
+    vkDestroySemaphore(m_device, frame.traceDone, nullptr);
+    vkDestroySemaphore(m_device, frame.computeDone, nullptr);
   }
+  m_asyncFrames.clear();
 
-    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, queryPool, 6);
-
-  m_debug.endLabel(cmdBuf);
-
-
-  /*
-    // Retrieve results
-    uint64_t timestamps[7] = {};  // Array size must match the number of timestamps written
-    vkGetQueryPoolResults(m_device, queryPool, 0, 7, sizeof(timestamps), timestamps, sizeof(uint64_t),
-                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
-
-    // Convert to time
-    double timestampPeriod = 1e-9;  // Typically in nanoseconds, but adjust based on your device's timestamp period
-
-    // Compute the time taken for each section
-    double timeRayTracing    = (timestamps[1] - timestamps[0]) * timestampPeriod;
-    double timeOffsetCompute = (timestamps[2] - timestamps[1]) * timestampPeriod;
-    double timeStatusCompute = (timestamps[3] - timestamps[2]) * timestampPeriod;
-    double timeIrradiance    = (timestamps[4] - timestamps[3]) * timestampPeriod;
-    double timeVisibility    = (timestamps[5] - timestamps[4]) * timestampPeriod;
-    double timeSampleCompute = (timestamps[6] - timestamps[5]) * timestampPeriod;
-
-    std::cout << "Ray Tracing Time: " << timeRayTracing << " seconds" << std::endl;
-    std::cout << "Offsets Compute Time: " << timeOffsetCompute << " seconds" << std::endl;
-    std::cout << "Status Compute Time: " << timeStatusCompute << " seconds" << std::endl;
-    std::cout << "Irradiance Compute Time: " << timeIrradiance << " seconds" << std::endl;
-    std::cout << "Visibility Compute Time: " << timeVisibility << " seconds" << std::endl;
-    std::cout << "Sample Compute Time: " << timeSampleCompute << " seconds" << std::endl;
-    */
-    
+  // Frees the compute command buffers with it
+  vkDestroyCommandPool(m_device, m_computeCmdPool, nullptr);
+  m_computeCmdPool = VK_NULL_HANDLE;
 }
 
 
@@ -1896,57 +2579,107 @@ void HelloVulkan::createIndirectPipeline() {
   VkPushConstantRange pushConstantOffset{VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
                                    0, sizeof(PushConstantOffset)};
 
+  VkPushConstantRange pushConstantSchedule{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantSchedule)};
+
   VkPushConstantRange pushConstantSample{VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT,
                                          0, sizeof(PushConstantSample)};
 
+  VkPushConstantRange pushConstantTemporal{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantTemporal)};
+
   
-  createComputePipeline("spv/probeOffsets.glsl.spv", indirectDescSetLayouts, m_probeOffsetsPipelineLayout,
-                        m_probeOffsetsPipeline, &pushConstantOffset, sizeof(pushConstantOffset));
+  createComputePipeline("spv/probeOffsets.glsl.spv", indirectDescSetLayouts, m_probeOffsetsPipeline, pushConstantOffset);
+
+  createComputePipeline("spv/probeStatus.glsl.spv", indirectDescSetLayouts, m_probeStatusPipeline, pushConstantOffset);
+
+  createComputePipeline("spv/probeScroll.glsl.spv", indirectDescSetLayouts, m_probeScrollPipeline, pushConstantSchedule);
+
+  createComputePipeline("spv/probePriority.glsl.spv", indirectDescSetLayouts, m_probePriorityPipeline, pushConstantSchedule);
+
+  createComputePipeline("spv/probeThreshold.glsl.spv", indirectDescSetLayouts, m_probeThresholdPipeline, pushConstantSchedule);
+
+  createComputePipeline("spv/probeCompact.glsl.spv", indirectDescSetLayouts, m_probeCompactPipeline, pushConstantSchedule);
+
+  createComputePipeline("spv/probeDirections.glsl.spv", indirectDescSetLayouts, m_probeDirectionsPipeline, pushConstantSchedule);
 
-  createComputePipeline("spv/probeStatus.glsl.spv", indirectDescSetLayouts, m_probeStatusPipelineLayout,
-                        m_probeStatusPipeline, &pushConstantOffset, sizeof(pushConstantOffset));
+  // Pipelines writing the atlases are built for the formats the atlases were created with
+  const std::string atlasVariant = volume.compact_atlases ? "_compact" : "";
 
-  createComputePipeline("spv/probeUpdateIrradiance.glsl.spv", indirectDescSetLayouts, m_probeUpdateIrradiancePipelineLayout,
-                        m_probeUpdateIrradiancePipeline, &pushConstant, sizeof(pushConstant));
+  createComputePipeline("spv/probeUpdateIrradiance" + atlasVariant + ".glsl.spv", indirectDescSetLayouts, m_probeUpdateIrradiancePipeline, pushConstant);
 
-  createComputePipeline("spv/probeUpdateVisibility.glsl.spv", indirectDescSetLayouts, m_probeUpdateVisibilityPipelineLayout,
-                        m_probeUpdateVisibilityPipeline, &pushConstant, sizeof(pushConstant));
+  createComputePipeline("spv/probeUpdateVisibility" + atlasVariant + ".glsl.spv", indirectDescSetLayouts, m_probeUpdateVisibilityPipeline, pushConstant);
+
+  createComputePipeline("spv/probeUpdateFused" + atlasVariant + ".glsl.spv", indirectDescSetLayouts, m_probeUpdateFusedPipeline, pushConstant);
+
+  createComputePipeline("spv/probeUpdateSH.glsl.spv", indirectDescSetLayouts, m_probeUpdateSHPipeline, pushConstant);
+
+  createComputePipeline("spv/probeBorder" + atlasVariant + ".glsl.spv", indirectDescSetLayouts, m_probeBorderPipeline, pushConstant);
   
-  createComputePipeline("spv/sampleIrradiance.glsl.spv", indirectDescSetLayouts, m_sampleIrradiancePipelineLayout,
-                        m_sampleIrradiancePipeline, &pushConstantSample, sizeof(pushConstantSample));
+  createComputePipeline("spv/sampleClassify.glsl.spv", indirectDescSetLayouts, m_sampleClassifyPipeline, pushConstantSample);
+
+  createComputePipeline("spv/sampleIrradiance.glsl.spv", indirectDescSetLayouts, m_sampleIrradiancePipeline, pushConstantSample);
+
+  createComputePipeline("spv/sampleIrradiance_coherent.glsl.spv", indirectDescSetLayouts, m_sampleCoherentPipeline, pushConstantSample);
+
+  createComputePipeline("spv/indirectUpsample.glsl.spv", indirectDescSetLayouts, m_indirectUpsamplePipeline, pushConstantSample);
+
+  createComputePipeline("spv/indirectTemporal.glsl.spv", indirectDescSetLayouts, m_indirectTemporalPipeline, pushConstantTemporal);
+
+  // Upper bounds of the indirect dispatches: 32 wide workgroups or one per scheduled probe (probeThreshold.glsl),
+  // one per classified sample tile (sampleClassify.glsl)
+  const uint32_t num_probes = volume.get_total_probes();
+  m_probeOffsetsPipeline.check_indirect_groups((num_probes + 31) / 32);
+  m_probeStatusPipeline.check_indirect_groups((num_probes + 31) / 32);
+  for(const Compute_Pipeline* blend : {&m_probeUpdateIrradiancePipeline, &m_probeUpdateVisibilityPipeline, &m_probeUpdateFusedPipeline,
+                                       &m_probeUpdateSHPipeline, &m_probeBorderPipeline}) {
+    blend->check_indirect_groups(num_probes);
+  }
+  m_sampleCoherentPipeline.check_indirect_groups(m_sampleTileCapacity);
+  m_sampleIrradiancePipeline.check_indirect_groups(m_sampleTileCapacity);
   
 }
 
 
-void HelloVulkan::createComputePipeline(const std::string&    shaderPath,
+//--------------------------------------------------------------------------------------------------
+// The workgroup size comes out of the module itself, dispatches are then sized with dispatch_for_extent()
+//
+void HelloVulkan::createComputePipeline(const std::string&                 shaderPath,
                                         std::vector<VkDescriptorSetLayout> IndirectDescSetLayouts,
-                                        VkPipelineLayout&     pipelineLayout,
-                                        VkPipeline&           pipeline,
-                                        const void*           pushConstants,
-                                        uint32_t              pushConstantsSize) {
+                                        Compute_Pipeline&                  pipeline,
+                                        const VkPushConstantRange&         pushConstants) {
 
   // Compile compute shader and package as stage.
-  VkShaderModule computeShader = nvvk::createShaderModule(m_device, nvh::loadFile(shaderPath, true, defaultSearchPaths, true));
+  const std::string code = nvh::loadFile(shaderPath, true, defaultSearchPaths, true);
+  if(!pipeline.reflect_local_size(code)) {
+    LOGE("No workgroup size found in %s\n", shaderPath.c_str());
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+  for(uint32_t axis = 0; axis < 3; ++axis) {
+    pipeline.max_group_count[axis] = properties.limits.maxComputeWorkGroupCount[axis];
+  }
+
+  VkShaderModule computeShader = nvvk::createShaderModule(m_device, code);
   VkPipelineShaderStageCreateInfo stageInfo{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
   stageInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
   stageInfo.module = computeShader;
   stageInfo.pName  = "main";
 
-  // Set up push constant and pipeline layout.
-  VkPushConstantRange        pushCRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantsSize };
+  // Set up push constant and pipeline layout, compute only whatever other stages the range was declared for
+  VkPushConstantRange        pushCRange = { VK_SHADER_STAGE_COMPUTE_BIT, pushConstants.offset, pushConstants.size };
   
   VkPipelineLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
   layoutInfo.setLayoutCount         = static_cast<uint32_t>(IndirectDescSetLayouts.size());
   layoutInfo.pSetLayouts            = IndirectDescSetLayouts.data();
   layoutInfo.pushConstantRangeCount = 1;
   layoutInfo.pPushConstantRanges    = &pushCRange;
-  vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &pipelineLayout);
+  vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &pipeline.layout);
 
   // Create compute pipeline.
   VkComputePipelineCreateInfo pipelineInfo { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
   pipelineInfo.stage  = stageInfo;
-  pipelineInfo.layout = pipelineLayout;
-  vkCreateComputePipelines(m_device, {}, 1, &pipelineInfo, nullptr, &pipeline);
+  pipelineInfo.layout = pipeline.layout;
+  vkCreateComputePipelines(m_device, {}, 1, &pipelineInfo, nullptr, &pipeline.pipeline);
 
   vkDestroyShaderModule(m_device, computeShader, nullptr);
 }
@@ -1955,16 +2688,8 @@ void HelloVulkan::createComputePipeline(const std::string&    shaderPath,
 // Buffers
 
 void HelloVulkan::createIndirectConstantsBuffer() {
-  nvvk::CommandPool cmdBufGet(m_device, m_graphicsQueueIndex);
-  VkCommandBuffer   cmdBuf = cmdBufGet.createCommandBuffer();
-
-  using Usage      = VkBufferUsageFlagBits;
-  m_bIndirectConstants = m_alloc.createBuffer(sizeof(Indirect_gpu_constants),
-                                          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-                                              | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_bIndirectConstants = createFrameRing(sizeof(Indirect_gpu_constants), m_indirectConstantsStride, m_indirectConstantsMapped);
   m_debug.setObjectName(m_bIndirectConstants.buffer, "IndirectConstantsBuffer");
-
 }
 
 void HelloVulkan::createIndirectStatusBuffer(){
@@ -1973,31 +2698,73 @@ void HelloVulkan::createIndirectStatusBuffer(){
 
   const uint32_t num_probes = volume.get_total_probes();
   using Usage   = VkBufferUsageFlagBits;
-  m_bIndirectStatus = m_alloc.createBuffer(sizeof(uint32_t) * num_probes,
-                                                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-                                                       | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VkBufferCreateInfo statusInfo = nvvk::makeBufferCreateInfo(sizeof(uint32_t) * num_probes,
+                                                              VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                                  | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  setAsyncSharing(statusInfo);
+  m_bIndirectStatus = m_alloc.createBuffer(statusInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   m_debug.setObjectName(m_bIndirectStatus.buffer, "IndirectStausBuffer");
 }
 
-void HelloVulkan::updateIndirectConstantsBuffer(const VkCommandBuffer& cmdBuf, renderSceneVolume& scene) {
+// Written on the GPU every frame by the scheduling pass, read back as indirect arguments
+void HelloVulkan::createActiveProbesBuffer() {
+  const uint32_t     num_probes = volume.get_total_probes();
+  VkBufferCreateInfo activeInfo = nvvk::makeBufferCreateInfo(sizeof(ProbeIndirectArgs) + sizeof(int32_t) * num_probes,
+                                                              VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                                  | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  setAsyncSharing(activeInfo);
+  m_bActiveProbes       = m_alloc.createBuffer(activeInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_activeProbesAddress = nvvk::getBufferDeviceAddress(m_device, m_bActiveProbes.buffer);
+  m_debug.setObjectName(m_bActiveProbes.buffer, "ActiveProbesBuffer");
+}
+
+// Ages, irradiance changes and luminance statistics carry over between frames, the histogram is cleared by the threshold pass
+void HelloVulkan::createProbeScheduleBuffer() {
+  const uint32_t     num_probes   = volume.get_total_probes();
+  VkBufferCreateInfo scheduleInfo = nvvk::makeBufferCreateInfo(sizeof(uint32_t) * PROBE_PRIORITY_BUCKETS + sizeof(ProbeScheduleInfo) * num_probes,
+                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  setAsyncSharing(scheduleInfo);
+  m_bProbeSchedule = m_alloc.createBuffer(scheduleInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_debug.setObjectName(m_bProbeSchedule.buffer, "ProbeScheduleBuffer");
+}
+
+// Filled on the GPU at the start of every frame from the random rotation of the constants
+void HelloVulkan::createRayDirectionsBuffer() {
+  VkBufferCreateInfo directionsInfo = nvvk::makeBufferCreateInfo(sizeof(glm::vec4) * PROBE_RAY_TABLE_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  setAsyncSharing(directionsInfo);
+  m_bRayDirections = m_alloc.createBuffer(directionsInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_debug.setObjectName(m_bRayDirections.buffer, "RayDirectionsBuffer");
+}
+
+// Rebuilt on the GPU every frame by the classification dispatch, sized for the full resolution tiles.
+// Like the indirect images it follows the size the GI was prepared at.
+void HelloVulkan::createSampleTilesBuffer() {
+  m_sampleTileCapacity = ((m_size.width + SAMPLE_TILE_SIZE - 1) / SAMPLE_TILE_SIZE) * ((m_size.height + SAMPLE_TILE_SIZE - 1) / SAMPLE_TILE_SIZE);
+  VkBufferCreateInfo tilesInfo = nvvk::makeBufferCreateInfo(sizeof(SampleTileArgs) + 2 * sizeof(uint32_t) * m_sampleTileCapacity,
+                                                             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                                                 | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  setAsyncSharing(tilesInfo);
+  m_bSampleTiles = m_alloc.createBuffer(tilesInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_debug.setObjectName(m_bSampleTiles.buffer, "SampleTilesBuffer");
+}
+
+void HelloVulkan::updateIndirectConstantsBuffer(renderSceneVolume& scene) {
   Indirect_gpu_constants hostIndirectConstBuffer = {};
   
   hostIndirectConstBuffer.radiance_output_index             = 0;
   hostIndirectConstBuffer.grid_irradiance_output_index      = 2;
   hostIndirectConstBuffer.indirect_output_index             = 2;
+  hostIndirectConstBuffer.indirect_low_res_index            = 4;
   hostIndirectConstBuffer.normal_texture_index              = 4;
   
   hostIndirectConstBuffer.depth_pyramid_texture_index       = 6;
   hostIndirectConstBuffer.depth_fullscreen_texture_index    = 5;
   hostIndirectConstBuffer.grid_visibility_texture_index     = 3;
   hostIndirectConstBuffer.probe_offset_texture_index        = 1;
+  hostIndirectConstBuffer.probe_sh_index                    = 3;
 
   hostIndirectConstBuffer.hysteresis                        = scene.gi_hysteresis;
   hostIndirectConstBuffer.infinte_bounces_multiplier        = scene.gi_infinite_bounces_multiplier;
-  hostIndirectConstBuffer.probe_update_offset               = volume.probe_update_offset;
-  hostIndirectConstBuffer.probe_update_count                = volume.per_frame_probe_updates;
-  //hostIndirectConstBuffer.probe_update_count                = 0;
 
   hostIndirectConstBuffer.probe_grid_position               = scene.gi_probe_grid_position;
   hostIndirectConstBuffer.probe_sphere_scale                = scene.gi_probe_sphere_scale;
@@ -2022,7 +2789,9 @@ void HelloVulkan::updateIndirectConstantsBuffer(const VkCommandBuffer& cmdBuf, r
                                                             | ((scene.gi_use_backface_blending ? 1 : 0) << 6) 
                                                             | ((scene.gi_use_probe_offsetting ? 1 : 0) << 7)
                                                             | ((scene.gi_use_probe_status ? 1 : 0) << 8) 
-                                                            | ((scene.gi_use_infinite_bounces ? 1 : 0) << 9);
+                                                            | ((scene.gi_use_infinite_bounces ? 1 : 0) << 9)
+                                                            | ((scene.gi_use_sh_irradiance ? 1 : 0) << 10)
+                                                            | ((scene.gi_use_surface_cache ? 1 : 0) << 11);
 
   // Irradiance - Visibility size settings
   hostIndirectConstBuffer.irradiance_texture_width          = volume.irradiance_atlas_width;
@@ -2030,15 +2799,37 @@ void HelloVulkan::updateIndirectConstantsBuffer(const VkCommandBuffer& cmdBuf, r
   hostIndirectConstBuffer.irradiance_side_length            = volume.irradiance_probe_size;
 
   hostIndirectConstBuffer.probe_rays                        = volume.probe_rays;
+  hostIndirectConstBuffer.probe_min_rays                    = scene.gi_use_adaptive_rays ? volume.probe_min_rays : volume.probe_rays;
 
   hostIndirectConstBuffer.visibility_texture_width          = volume.visibility_atlas_width;
   hostIndirectConstBuffer.visibility_texture_height         = volume.visibility_atlas_height;
   hostIndirectConstBuffer.visibility_side_length            = volume.visibility_probe_size;
 
 
-  hostIndirectConstBuffer.probe_update_offset               = volume.probe_update_offset;
-  hostIndirectConstBuffer.probe_update_count                = volume.per_frame_probe_updates;
-  //hostIndirectConstBuffer.probe_update_count                = 0;
+  // Volumes. Scrolls relocate only the probes they expose, a full placement of the main grid relocates every probe.
+  volume.update_cascades(scene.gi_follow_camera, CameraManip.getEye(), scene.gi_probe_grid_position, scene.gi_probe_spacing);
+  volume.update_extra_volumes(scene.gi_extra_volumes);
+  if(scene.gi_recalculate_offsets || volume.cascades_reset) {
+    volume.offsets_calculations_count = PROBE_RELOCATION_FRAMES;
+  }
+
+  // Probe update budget, the whole grid while the offsets are being (re)placed
+  volume.per_frame_probe_updates = scene.gi_per_frame_probes_update;
+  volume.sh_irradiance           = scene.gi_use_sh_irradiance;
+
+  hostIndirectConstBuffer.probe_volume_count                = volume.volume_count;
+  for(uint32_t v = 0; v < volume.volume_count; ++v) {
+    const Probe_Grid&           grid      = volume.volumes[v];
+    Probe_volume_gpu_constants& constants = hostIndirectConstBuffer.probe_volumes[v];
+    constants.origin                      = glm::vec4(grid.origin, 0.0f);
+    constants.spacing                     = glm::vec4(grid.spacing, glm::length(grid.spacing) / glm::length(scene.gi_probe_spacing));
+    constants.counts                      = glm::ivec4(grid.counts, grid.first_probe);
+    constants.scroll                      = glm::ivec4(grid.scroll, grid.first_tile_row);
+    constants.scroll_delta                = glm::ivec4(grid.delta, grid.rays);
+  }
+
+  hostIndirectConstBuffer.probe_age_horizon                 = volume.get_probe_age_horizon();
+  hostIndirectConstBuffer.probe_update_count                = volume.get_scheduled_probes();
   
 
   // Rotations
@@ -2049,45 +2840,23 @@ void HelloVulkan::updateIndirectConstantsBuffer(const VkCommandBuffer& cmdBuf, r
   // Resolution
   hostIndirectConstBuffer.resolution                        = glm::vec2(m_size.width, m_size.height);
 
-  const uint32_t num_probes                                 = volume.probe_count_x * volume.probe_count_y * volume.probe_count_z;
-  volume.probe_update_offset = (volume.probe_update_offset + volume.per_frame_probe_updates) % num_probes;
-  volume.per_frame_probe_updates    = scene.gi_per_frame_probes_update;
-
-
+  // Temporal accumulation, every frame writes the history and guide images the previous one read
+  ++m_temporalFrame;
+  const uint32_t historyOutput                              = getTemporalOutput();
+  hostIndirectConstBuffer.motion_texture_index              = 9;
+  hostIndirectConstBuffer.indirect_history_index            = 5 + (historyOutput ^ 1);
+  hostIndirectConstBuffer.indirect_history_output_index     = 5 + historyOutput;
+  hostIndirectConstBuffer.indirect_guide_index              = 7 + (historyOutput ^ 1);
+  hostIndirectConstBuffer.indirect_guide_output_index       = 7 + historyOutput;
+  hostIndirectConstBuffer.temporal_max_history              = scene.gi_temporal_max_history;
 
 
 
-  // Constants Buffer
-  VkBuffer deviceIndirectConstBuffer = m_bIndirectConstants.buffer;
-  auto     indirectConstUsageStages  = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
 
 
-  // Ensure that the modified UBO is not visible to previous frames.
-  VkBufferMemoryBarrier beforeBarrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  beforeBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  beforeBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  beforeBarrier.buffer        = deviceIndirectConstBuffer;
-  beforeBarrier.offset        = 0;
-  beforeBarrier.size          = sizeof(hostIndirectConstBuffer);
 
-  vkCmdPipelineBarrier(cmdBuf, indirectConstUsageStages, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT,
-                       0,
-                       nullptr, 1, &beforeBarrier, 0, nullptr);
-
-
-  // Schedule the host-to-device upload. (hostIndirectConstants is copied into the cmd
-  // buffer so it is okay to deallocate when the function returns).
-  vkCmdUpdateBuffer(cmdBuf, m_bIndirectConstants.buffer, 0, sizeof(Indirect_gpu_constants), &hostIndirectConstBuffer);
-  
-  // Making sure the updated UBO will be visible.
-  VkBufferMemoryBarrier afterBarrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  afterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  afterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  afterBarrier.buffer        = deviceIndirectConstBuffer;
-  afterBarrier.offset        = 0;
-  afterBarrier.size          = sizeof(hostIndirectConstBuffer);
-  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, indirectConstUsageStages, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, nullptr, 1, &afterBarrier, 0, nullptr);
-                       
+  // Constants Buffer, written into the slot of this frame
+  memcpy(m_indirectConstantsMapped + m_indirectConstantsStride * getCurFrame(), &hostIndirectConstBuffer, sizeof(Indirect_gpu_constants));
 }
 
 
@@ -2273,11 +3042,12 @@ void HelloVulkan::drawDebug(VkCommandBuffer cmdBuf) {
   setViewport(cmdBuf);
 
   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
+  std::vector<uint32_t>        dynamicOffsets = frameDynamicOffsets();
 
   // Drawing all triangles
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_debugPipeline);
   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_debugPipelineLayout, 0, (uint32_t)descSets.size(),
-                          descSets.data(), 0, nullptr);
+                          descSets.data(), (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
 
   for(const HelloVulkan::ObjInstance& inst : m_debugInstances) {
     auto& model            = m_debugObjModel[inst.objIndex];
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "nvvkhl/appbase_vk.hpp"
 #include "nvvk/debug_util_vk.hpp"
 #include "nvvk/descriptorsets_vk.hpp"
@@ -10,11 +12,15 @@
 
 #include "Gpu_Constants.h"
 #include "Probe_Volume.h"
+#include "Frame_Graph.h"
+#include "Compute_Pipeline.h"
 
 
 // #VKRay
 #include "nvvk/raytraceKHR_vk.hpp"
 
+class ObjLoader;
+
 //--------------------------------------------------------------------------------------------------
 // Simple rasterizer of OBJ objects
 // - Each OBJ loaded are stored in an `ObjModel` and referenced by a `ObjInstance`
@@ -25,6 +31,8 @@
 class HelloVulkan : public nvvkhl::AppBaseVk {
 
 public:
+  struct TextureTexels;
+
   void setup(const VkInstance& instance, const VkDevice& device, const VkPhysicalDevice& physicalDevice, uint32_t queueFamily) override;
   void createDescriptorSetLayout();
   void createGraphicsPipeline();
@@ -32,8 +40,9 @@ public:
   void updateDescriptorSet();
   void createUniformBuffer();
   void createObjDescriptionBuffer();
-  void createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures);
-  void updateUniformBuffer(const VkCommandBuffer& cmdBuf);
+  void createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures,
+                           std::vector<TextureTexels>* texels = nullptr);
+  void updateUniformBuffer();
   void onResize(int /*w*/, int /*h*/) override;
   void destroyResources();
   void rasterize(const VkCommandBuffer& cmdBuff);
@@ -46,8 +55,20 @@ public:
     nvvk::Buffer indexBuffer;     // Device buffer of the indices forming triangles
     nvvk::Buffer matColorBuffer;  // Device buffer of array of 'Wavefront material'
     nvvk::Buffer matIndexBuffer;  // Device buffer of array of 'Wavefront material'
+    nvvk::Buffer surfaceBuffer;   // Device buffer of the per triangle 'SurfaceRecord'
+  };
+
+  // Prefiltered linear copy of a texture, sampled on the host while building the surface cache
+  struct TextureTexels {
+    std::vector<glm::uvec2>             sizes;   // Size of each level, halved down to 1x1
+    std::vector<std::vector<glm::vec3>> levels;  // Linear colour of each level
+
+    glm::vec3 sample(glm::vec2 uv, float uvArea) const;
   };
 
+  TextureTexels              makeTextureTexels(const uint8_t* pixels, int width, int height);
+  std::vector<SurfaceRecord> buildSurfaceCache(const ObjLoader& loader, const std::vector<TextureTexels>& texels);
+
   struct ObjInstance {
     glm::mat4 transform;    // Matrix of the instance
     glm::mat4 invTransform = glm::inverse(transform);
@@ -83,9 +104,12 @@ public:
   VkDescriptorSetLayout       m_descSetLayout;
   VkDescriptorSet             m_descSet;
 
-  nvvk::Buffer m_bGlobals;  // Device-Host of the camera matrices
+  nvvk::Buffer m_bGlobals;  // Host-visible ring of the camera matrices, one slot per frame in flight
   nvvk::Buffer m_bObjDesc;  // Device buffer of the OBJ descriptions
 
+  glm::mat4 m_prevViewProj{1};  // Camera of the last updateUniformBuffer, the motion vectors measure against it
+  bool      m_hasPrevViewProj{false};
+
 
   std::vector<nvvk::Texture> m_textures;  // vector of all textures of the scene
 
@@ -169,10 +193,8 @@ public:
   void createIndirectShaderBindingTable();
   void createComputePipeline(const std::string& shaderPath,
                              std::vector<VkDescriptorSetLayout> IndirectDescSetLayouts,
-                             VkPipelineLayout& pipelineLayout,
-                             VkPipeline& pipeline,
-                             const void* pushConstants,
-                             uint32_t pushConstantsSize);
+                             Compute_Pipeline& pipeline,
+                             const VkPushConstantRange& pushConstants);
 
 
   std::vector<VkRayTracingShaderGroupCreateInfoKHR> m_IndirectShaderGroups;
@@ -188,7 +210,9 @@ public:
   // Push constant for ray tracer
   PushConstantOffset m_pcProbeOffsets{};
   PushConstantStatus m_pcProbeStatus{};
+  PushConstantSchedule m_pcProbeSchedule{};
   PushConstantSample m_pcSampleIrradiance{};
+  PushConstantTemporal m_pcIndirectTemporal{};
 
   // Textures Vector
   std::vector<nvvk::Texture> m_storageImages;
@@ -201,6 +225,19 @@ public:
 
   nvvk::Image              m_indirectImage;
   nvvk::Texture            m_indirectTexture;
+  nvvk::Image              m_indirectLowResImage;  // Reduced resolution irradiance, upsampled into m_indirectImage
+  nvvk::Texture            m_indirectLowResTexture;
+
+  // Temporal accumulation, written and read alternately: one holds last frame's result while the other receives this frame's
+  std::array<nvvk::Image, 2>   m_indirectHistoryImages;  // Accumulated irradiance, history length in alpha
+  std::array<nvvk::Texture, 2> m_indirectHistoryTextures;
+  std::array<nvvk::Image, 2>   m_indirectGuideImages;  // Octahedral normal and view depth of each accumulated pixel
+  std::array<nvvk::Texture, 2> m_indirectGuideTextures;
+
+  uint32_t m_temporalFrame{0};                 // Picks the history images and the sampled pixel of each block
+  uint32_t m_lastAccumulatedFrame{UINT32_MAX};  // The accumulation restarts after a frame without it
+  bool     isTemporalAccumulating() const { return m_lastAccumulatedFrame == m_temporalFrame; }  // Accumulated this frame
+  uint32_t getTemporalOutput() const { return m_temporalFrame & 1; }  // History and guide written this frame
 
   nvvk::Image              m_radianceImage;
   nvvk::Texture            m_radianceTexture;
@@ -214,34 +251,61 @@ public:
   nvvk::Image              m_visibilityImage;
   nvvk::Texture            m_visibilityTexture;
 
+  nvvk::Image              m_probeSHImage;  // L1 SH irradiance, a row of PROBE_SH_COEFFICIENTS texels per probe
+  nvvk::Texture            m_probeSHTexture;
+
   nvvk::Image createStorageImage(const VkCommandBuffer& cmdBuf, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format);
 
   // Buffers
   nvvk::Buffer m_bIndirectConstants;
   nvvk::Buffer m_bIndirectStatus;
+  nvvk::Buffer m_bActiveProbes;  // ProbeIndirectArgs followed by the packed active probe indices
+  VkDeviceAddress m_activeProbesAddress{0};
+  nvvk::Buffer m_bProbeSchedule;  // Priority histogram followed by a ProbeScheduleInfo per probe
+  nvvk::Buffer m_bRayDirections;  // Rotated ray directions of every ray count, refreshed each frame
+  nvvk::Buffer m_bSampleTiles;    // SampleTileArgs followed by the coherent and mixed tile lists of the irradiance sampling
+  uint32_t     m_sampleTileCapacity{0};  // Tiles of the sampling dispatch at full resolution, room of each list
 
   // Compute Pipelines
-  VkPipelineLayout m_probeOffsetsPipelineLayout;
-  VkPipeline       m_probeOffsetsPipeline;
-
-  VkPipelineLayout m_probeStatusPipelineLayout;
-  VkPipeline       m_probeStatusPipeline;
-
-  VkPipelineLayout m_probeUpdateIrradiancePipelineLayout;
-  VkPipeline       m_probeUpdateIrradiancePipeline;
-  
-  VkPipelineLayout m_probeUpdateVisibilityPipelineLayout;
-  VkPipeline       m_probeUpdateVisibilityPipeline;
-
-  VkPipelineLayout m_sampleIrradiancePipelineLayout;
-  VkPipeline       m_sampleIrradiancePipeline;
+  Compute_Pipeline m_probeOffsetsPipeline;
+  Compute_Pipeline m_probeStatusPipeline;
+  Compute_Pipeline m_probeScrollPipeline;            // Resets the probes a scrolling volume exposed
+  Compute_Pipeline m_probePriorityPipeline;
+  Compute_Pipeline m_probeThresholdPipeline;
+  Compute_Pipeline m_probeCompactPipeline;
+  Compute_Pipeline m_probeDirectionsPipeline;
+  Compute_Pipeline m_probeUpdateIrradiancePipeline;
+  Compute_Pipeline m_probeUpdateVisibilityPipeline;
+  Compute_Pipeline m_probeUpdateFusedPipeline;       // Irradiance and visibility blended in one pass
+  Compute_Pipeline m_probeUpdateSHPipeline;          // SH projection, replaces the irradiance blend in SH mode
+  Compute_Pipeline m_probeBorderPipeline;            // Border texels of the blended probes, both atlases
+  Compute_Pipeline m_sampleClassifyPipeline;         // Sorts the sampling tiles into sky, coherent and mixed
+  Compute_Pipeline m_sampleIrradiancePipeline;
+  Compute_Pipeline m_sampleCoherentPipeline;         // Sampling of the tiles inside a single probe cell
+  Compute_Pipeline m_indirectUpsamplePipeline;       // Joint bilateral upsample of the reduced resolution irradiance
+  Compute_Pipeline m_indirectTemporalPipeline;       // Reprojects and accumulates the indirect lighting over frames
 
   void createIndirectConstantsBuffer();
   void createIndirectStatusBuffer();
+  void createActiveProbesBuffer();
+  void createProbeScheduleBuffer();
+  void createRayDirectionsBuffer();
+  void createSampleTilesBuffer();
 
-  void updateIndirectConstantsBuffer(const VkCommandBuffer& cmdBuf, renderSceneVolume& scene);
+  void updateIndirectConstantsBuffer(renderSceneVolume& scene);
 
-  void IndirectBegin(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor, renderSceneVolume& scene);
+  // Per-frame constant rings
+  // - Persistently mapped and coherent, so the slot of the next frame is written while the GPU still reads the current one
+  // - Bound as dynamic uniform buffers; frameDynamicOffsets() selects the slot of the current frame
+  nvvk::Buffer          createFrameRing(VkDeviceSize size, VkDeviceSize& stride, uint8_t*& mapped);
+  std::vector<uint32_t> frameDynamicOffsets(bool withRtSet = true);
+
+  VkDeviceSize m_globalsStride{0};
+  uint8_t*     m_globalsMapped{nullptr};
+  VkDeviceSize m_indirectConstantsStride{0};
+  uint8_t*     m_indirectConstantsMapped{nullptr};
+
+  void addIndirectPasses(Frame_Graph& graph, const glm::vec4& clearColor, renderSceneVolume& scene);
 
   void prepareIndirectComponents(renderSceneVolume& scene);
   
@@ -254,21 +318,23 @@ public:
   VkRenderPass     m_gBufferRenderPass{VK_NULL_HANDLE};
   VkFramebuffer    m_gBufferFramebuffer{VK_NULL_HANDLE};
 
-  void createGBufferRender();
-  void gBufferBegin(const VkCommandBuffer& cmdBuff);
-  void createGBufferPipeline();
+  void     selectGBufferFormats(bool compact);  // Before createGBufferRender
+  void     createGBufferRender();
+  void     gBufferBegin(const VkCommandBuffer& cmdBuff);
+  void     createGBufferPipeline();
+  uint32_t getGBufferBytesPerPixel() const;  // Written by the G-buffer pass, depth included
 
-  nvvk::Texture m_gBufferNormals;
-  nvvk::Texture m_gBufferDepthTexture;
+  nvvk::Texture m_gBufferNormals;  // Octahedral encoded, two components
   nvvk::Texture m_gBufferAlbedo;
   nvvk::Texture m_gBufferDiffuse;
-  nvvk::Texture m_gBufferDepth;
+  nvvk::Texture m_gBufferMotion;  // Screen uv of this frame minus the previous one
+  nvvk::Texture m_gBufferDepth;   // Hardware depth, sampled to reconstruct positions
 
-  VkFormat      m_gBufferNormalFormat{VK_FORMAT_R32G32B32A32_SFLOAT};
-  VkFormat      m_gBufferDepthTextureFormat{VK_FORMAT_R32G32B32A32_SFLOAT};
-  VkFormat      m_gBufferAlbedoFormat{VK_FORMAT_R32G32B32A32_SFLOAT};
-  VkFormat      m_gBufferDiffuseFormat{VK_FORMAT_R32G32B32A32_SFLOAT};
-  VkFormat      m_gBufferDepthFormat{VK_FORMAT_X8_D24_UNORM_PACK32};
+  VkFormat      m_gBufferNormalFormat{VK_FORMAT_R16G16_SFLOAT};
+  VkFormat      m_gBufferAlbedoFormat{VK_FORMAT_R8G8B8A8_SRGB};
+  VkFormat      m_gBufferDiffuseFormat{VK_FORMAT_B10G11R11_UFLOAT_PACK32};
+  VkFormat      m_gBufferMotionFormat{VK_FORMAT_R16G16_SFLOAT};
+  VkFormat      m_gBufferDepthFormat{VK_FORMAT_D32_SFLOAT};  // Every device can sample it
 
 
 
@@ -300,5 +366,60 @@ public:
 
 
 
-  VkQueryPool queryPool;
+  //////////////////////////////////////////////////////////////////////////
+  // Frame Graph
+  //////////////////////////////////////////////////////////////////////////
+  struct GraphResources {
+    uint32_t gBufferNormals;
+    uint32_t gBufferDepth;
+    uint32_t gBufferAlbedo;
+    uint32_t gBufferDiffuse;
+    uint32_t gBufferMotion;
+    uint32_t radiance;
+    uint32_t offsets;
+    uint32_t status;
+    uint32_t activeProbes;
+    uint32_t schedule;
+    uint32_t rayDirections;
+    uint32_t sampleTiles;
+    uint32_t irradiance;
+    uint32_t visibility;
+    uint32_t probeSH;
+    uint32_t indirect;
+    uint32_t indirectLowRes;
+    uint32_t indirectHistory[2];
+    uint32_t indirectGuide[2];
+    uint32_t offscreenColor;
+    uint32_t debugColor;
+  };
+  GraphResources m_graphResources{};
+
+  void importGraphResources(Frame_Graph& graph);
+
+
+
+
+  //////////////////////////////////////////////////////////////////////////
+  // Async Compute
+  //////////////////////////////////////////////////////////////////////////
+  // The probe update chain runs on a dedicated compute queue:
+  // probe trace (graphics) -> status/offsets/blending (compute) -> rest of the frame (graphics)
+  struct AsyncFrame {
+    VkCommandBuffer traceCmdBuf{VK_NULL_HANDLE};    // Graphics work the compute chain waits on
+    VkCommandBuffer computeCmdBuf{VK_NULL_HANDLE};  // Probe update chain
+    VkSemaphore     traceDone{VK_NULL_HANDLE};
+    VkSemaphore     computeDone{VK_NULL_HANDLE};
+  };
+
+  void initAsyncCompute(VkQueue computeQueue, uint32_t computeQueueFamily);
+  void setAsyncSharing(VkImageCreateInfo& createInfo);
+  void setAsyncSharing(VkBufferCreateInfo& createInfo);
+  void submitAsyncFrame();
+  void destroyAsyncCompute();
+
+  bool                    m_asyncCompute{false};
+  VkQueue                 m_computeQueue{VK_NULL_HANDLE};
+  VkCommandPool           m_computeCmdPool{VK_NULL_HANDLE};
+  std::array<uint32_t, 2> m_asyncQueueFamilies{};  // Graphics and compute, for concurrent sharing
+  std::vector<AsyncFrame> m_asyncFrames;
 };
\ No newline at end of file
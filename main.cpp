@@ -1,4 +1,5 @@
 #include <array>
+#include <cstring>
 
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "backends/imgui_impl_glfw.h"
@@ -7,12 +8,14 @@
 #include "imgui/imgui_helper.h"
 
 #include "hello_vulkan.h"
+#include "Gpu_Profiler.h"
 #include "Gpu_Constants.h"
 
 
 #include "imgui/imgui_camera_widget.h"
 #include "nvh/cameramanipulator.hpp"
 #include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
 #include "nvpsystem.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/context_vk.hpp"
@@ -48,19 +51,73 @@ void renderUI(HelloVulkan& helloVk, renderSceneVolume& scene)
   if(ImGui::CollapsingHeader("Irradiance Field")) {
     scene.gi_recalculate_offsets = false;
       
-    if(ImGui::SliderFloat3("Probe Grid Position", &scene.gi_probe_grid_position.x, -100.f, 100.f, "%2.3f")) {
-      scene.gi_recalculate_offsets = true;
+    // Moves and spacing changes are picked up by the cascade placement. Whole cell moves keep the probe history and
+    // only relocate the exposed planes, anything else places the grid again.
+    ImGui::SliderFloat3("Probe Grid Position", &scene.gi_probe_grid_position.x, -100.f, 100.f, "%2.3f");
+    static glm::ivec3 grid_shift{0};
+    ImGui::InputInt3("Grid Shift (cells)", &grid_shift.x);
+    if(ImGui::Button("Shift Grid")) {
+      scene.gi_probe_grid_position += glm::vec3(grid_shift) * scene.gi_probe_spacing;
     }
 
     ImGui::Checkbox("Use Infinite Bounces", &scene.gi_use_infinite_bounces);
+    ImGui::Checkbox("Use Surface Cache", &scene.gi_use_surface_cache);
     ImGui::SliderFloat("Infinite bounces multiplier", &scene.gi_infinite_bounces_multiplier, 0.0f, 1.0f);
 
-    if(ImGui::SliderFloat3("Probe Spacing", &scene.gi_probe_spacing.x, 0.f, 10.f, "%2.3f")) {
-      scene.gi_recalculate_offsets = true;
-    }  
+    ImGui::SliderFloat3("Probe Spacing", &scene.gi_probe_spacing.x, 0.f, 10.f, "%2.3f");
+
+    // Cascades keep their probes while scrolling, only the exposed planes are traced again
+    ImGui::Checkbox("Follow Camera", &scene.gi_follow_camera);
+    ImGui::Text("Volumes: %u extra, %u cascades, %u probes", helloVk.volume.first_cascade, helloVk.volume.cascade_count,
+                helloVk.volume.get_total_probes());
+
+    // Extra volumes keep their counts and rays, moving one relocates all of its probes
+    for(uint32_t v = 0; v < helloVk.volume.first_cascade; ++v) {
+      Probe_Grid_Settings& extra = scene.gi_extra_volumes[v];
+      ImGui::PushID(int(v));
+      ImGui::Text("Volume %u: %d x %d x %d probes, %d rays", v, helloVk.volume.volumes[v].counts.x, helloVk.volume.volumes[v].counts.y,
+                  helloVk.volume.volumes[v].counts.z, helloVk.volume.volumes[v].rays);
+      ImGui::SliderFloat3("Volume Position", &extra.position.x, -100.f, 100.f, "%2.3f");
+      ImGui::SliderFloat3("Volume Spacing", &extra.spacing.x, 0.01f, 10.f, "%2.3f");
+      ImGui::PopID();
+    }
 
 
     ImGui::SliderFloat("Hysteresis", &scene.gi_hysteresis, 0.0f, 1.0f);
+
+    const uint32_t min_probe_updates = 1;
+    ImGui::SliderScalar("Probes per frame", ImGuiDataType_U32, &scene.gi_per_frame_probes_update, &min_probe_updates, &scene.gi_total_probes);
+    ImGui::Checkbox("Use Adaptive Ray Counts", &scene.gi_use_adaptive_rays);
+    ImGui::Checkbox("Use Fused Probe Blend", &scene.gi_use_fused_blend);
+    ImGui::Checkbox("Use SH Irradiance", &scene.gi_use_sh_irradiance);
+
+    // Sampling resolution, anything below full is upsampled bilaterally by depth and normal
+    ImGui::Text("Irradiance Resolution");
+    for(uint32_t divider : {1u, 2u, 4u}) {
+      ImGui::SameLine();
+      if(ImGui::RadioButton(divider == 1 ? "Full" : (divider == 2 ? "Half" : "Quarter"), scene.gi_resolution_divider == divider)) {
+        scene.gi_resolution_divider = divider;
+      }
+    }
+    ImGui::Checkbox("Classify Sampling Tiles", &scene.gi_use_sample_tiles);
+
+    // Temporal accumulation, rejected by depth and normal where the reprojected history belongs to another surface
+    ImGui::Checkbox("Use Temporal Accumulation", &scene.gi_use_temporal);
+    ImGui::SliderFloat("Temporal Max History", &scene.gi_temporal_max_history, 1.0f, 64.0f);
+
+    // Storage of the radiance texture and atlases, and an estimate of the traffic they cause every frame
+    const VkExtent2D size           = helloVk.getSize();
+    const uint32_t   divider        = glm::max(scene.gi_resolution_divider, 1u);
+    const uint64_t   sampled_pixels = uint64_t((size.width + divider - 1) / divider) * ((size.height + divider - 1) / divider);
+    const float      megabyte       = 1024.0f * 1024.0f;
+    ImGui::Text("Atlases: %s", helloVk.volume.compact_atlases ? "R11G11B10 irradiance, RG16F visibility" : "RGBA16F");
+    ImGui::Text("Probe texture memory: %.2f MB", helloVk.volume.get_texture_memory() / megabyte);
+    ImGui::Text("Atlas traffic per frame: %.2f MB blend, %.2f MB sample", helloVk.volume.get_blend_bandwidth() / megabyte,
+                helloVk.volume.get_sample_bandwidth(sampled_pixels) / megabyte);
+    // The G-Buffer pass time is in the profiler below, compare it against the wide layout by flipping gi_use_compact_gbuffer
+    const uint32_t gbuffer_bytes = helloVk.getGBufferBytesPerPixel();
+    ImGui::Text("G-buffer: %u bytes per pixel, %.2f MB written per frame", gbuffer_bytes,
+                uint64_t(gbuffer_bytes) * size.width * size.height / megabyte);
     
     if(ImGui::SliderFloat("Max Probe Offset", &scene.gi_max_probe_offset, 0.0f, 0.5f)){
       scene.gi_recalculate_offsets = true;
@@ -83,7 +140,47 @@ void renderUI(HelloVulkan& helloVk, renderSceneVolume& scene)
 
   if(ImGui::CollapsingHeader("Debug Textures")){
     ImGui::Checkbox("Show Debug Textures", &helloVk.volume.m_showDebugTextures);
-    ImGui::SliderInt("Current Texture", &helloVk.volume.m_currentTextureDebug, 0, 8);
+    ImGui::SliderInt("Current Texture", &helloVk.volume.m_currentTextureDebug, 0, 11);
+  }
+}
+
+// Execution order of the last frame, with the barriers recorded in front of each pass
+void renderFrameGraphUI(const Frame_Graph& frameGraph)
+{
+  if(ImGui::CollapsingHeader("Frame Graph")) {
+    for(const Frame_Graph::Pass_Info& pass : frameGraph.get_schedule()) {
+      if(pass.culled) {
+        ImGui::TextDisabled("%-20s culled", pass.name.c_str());
+      } else {
+        const char* queue = pass.batch == Frame_Graph::BATCH_ASYNC ? "async" : "";
+        ImGui::Text("%-20s %u barriers  %.3f ms CPU %s", pass.name.c_str(), pass.barrier_count, pass.cpu_time_ms, queue);
+      }
+    }
+  }
+}
+
+void renderProfilerUI(const Gpu_Profiler& profiler)
+{
+  if(ImGui::CollapsingHeader("GPU Profiler", ImGuiTreeNodeFlags_DefaultOpen)) {
+    float total = 0.0f;
+    ImGui::Text("%-20s %8s %8s %8s", "Scope (ms)", "avg", "min", "max");
+    for(const Gpu_Profiler::Scope_Stats& scope : profiler.get_stats()) {
+      if(scope.no_timestamps) {
+        ImGui::TextDisabled("%-20s no timestamps on its queue", scope.name.c_str());
+        continue;
+      }
+      ImGui::Text("%-20s %8.3f %8.3f %8.3f", scope.name.c_str(), scope.avg_ms, scope.min_ms, scope.max_ms);
+      total += scope.avg_ms;
+    }
+    ImGui::Text("%-20s %8.3f", "Total", total);
+
+    if(ImGui::Button("Export CSV")) {
+      profiler.export_csv("gpu_profile.csv");
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Export JSON")) {
+      profiler.export_json("gpu_profile.json");
+    }
   }
 }
 
@@ -98,7 +195,11 @@ static int const SAMPLE_HEIGHT = 720;
 // Application Entry
 //
 int main(int argc, char** argv) {
-  UNUSED(argc);
+  // --async-compute: probe updates on a dedicated compute queue, when the device has one
+  bool asyncCompute = false;
+  for(int i = 1; i < argc; ++i) {
+    asyncCompute = asyncCompute || strcmp(argv[i], "--async-compute") == 0;
+  }
 
   // Setup GLFW window
   glfwSetErrorCallback(onErrorCallback);
@@ -173,6 +274,15 @@ int main(int argc, char** argv) {
   helloVk.createRenderPass();
   helloVk.createFrameBuffers();
 
+  // Async compute needs a queue of its own, otherwise everything stays on the GCT queue
+  if(asyncCompute) {
+    if(vkctx.m_queueC.queue != VK_NULL_HANDLE && vkctx.m_queueC.familyIndex != vkctx.m_queueGCT.familyIndex) {
+      helloVk.initAsyncCompute(vkctx.m_queueC.queue, vkctx.m_queueC.familyIndex);
+    } else {
+      LOGI("No separate compute queue family, probe updates stay on the graphics queue\n");
+    }
+  }
+
   // Setup Imgui
   helloVk.initGUI(0);  // Using sub-pass 0
 
@@ -195,6 +305,7 @@ int main(int argc, char** argv) {
   helloVk.updateDescriptorSet();
 
   // G Buffer Normals
+  helloVk.selectGBufferFormats(scene.gi_use_compact_gbuffer);
   helloVk.createGBufferRender();
   helloVk.createGBufferPipeline();
 
@@ -225,6 +336,16 @@ int main(int argc, char** argv) {
   bool      useIndirect  = true;
 
 
+  Frame_Graph frameGraph;
+
+  // Every pass of the frame graph is a profiler scope
+  Gpu_Profiler profiler;
+  profiler.init(vkctx.m_device, vkctx.m_physicalDevice, vkctx.m_queueGCT.familyIndex,
+                static_cast<uint32_t>(helloVk.getFramebuffers().size()));
+  frameGraph.on_pass_begin = [&](VkCommandBuffer cmdBuf, const std::string& name) { profiler.begin_scope(cmdBuf, name); };
+  frameGraph.on_pass_end   = [&](VkCommandBuffer cmdBuf, const std::string&) { profiler.end_scope(cmdBuf); };
+
+
   helloVk.setupGlfwCallbacks(window);
   ImGui_ImplGlfw_InitForVulkan(window, true);
 
@@ -250,6 +371,8 @@ int main(int argc, char** argv) {
 
       renderUI(helloVk, scene);
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+      renderProfilerUI(profiler);
+      renderFrameGraphUI(frameGraph);
       ImGuiH::Control::Info("", "", "(F10) Toggle Pane", ImGuiH::Control::Flags::Disabled);
       ImGuiH::Panel::End();
     }
@@ -262,13 +385,16 @@ int main(int argc, char** argv) {
     auto                   curFrame = helloVk.getCurFrame();
     const VkCommandBuffer& cmdBuf   = helloVk.getCommandBuffers()[curFrame];
 
+    // The fence of this frame was waited on: its timestamps from the last round are ready
+    profiler.begin_frame(curFrame);
+
     VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     vkBeginCommandBuffer(cmdBuf, &beginInfo);
 
-    // Updating camera buffer
-    helloVk.updateUniformBuffer(cmdBuf);
-    helloVk.updateIndirectConstantsBuffer(cmdBuf, scene);
+    // Updating the constants of this frame
+    helloVk.updateUniformBuffer();
+    helloVk.updateIndirectConstantsBuffer(scene);
 
 
 
@@ -286,111 +412,157 @@ int main(int argc, char** argv) {
     clearValuesGBuffer[0].color  = {{clearColor3[0], clearColor3[1], clearColor3[2], clearColor3[3]}};
     clearValuesGBuffer[1].color  = {{clearColor3[0], clearColor3[1], clearColor3[2], clearColor3[3]}};
     clearValuesGBuffer[2].color  = {{clearColor3[0], clearColor3[1], clearColor3[2], clearColor3[3]}};
-    clearValuesGBuffer[3].color  = {{clearColor3[0], clearColor3[1], clearColor3[2], clearColor3[3]}};
-    clearValuesGBuffer[4].depthStencil = {1.0f, 0};
+    clearValuesGBuffer[3].color  = {{0.0f, 0.0f, 0.0f, 0.0f}};  // No motion where nothing was drawn
+    clearValuesGBuffer[4].depthStencil = {1.0f, 0};  // Sampled as the scene depth, 1 is the sky
    
     
-    // Normals GBuffer
-    {
-      VkRenderPassBeginInfo gBufferRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-      gBufferRenderPassBeginInfo.renderPass      = helloVk.m_gBufferRenderPass;   // The render pass created earlier
-      gBufferRenderPassBeginInfo.framebuffer     = helloVk.m_gBufferFramebuffer;  // The framebuffer created earlier
-      gBufferRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};   // The area to render to
-      gBufferRenderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValuesGBuffer.size());
-      gBufferRenderPassBeginInfo.pClearValues    = clearValuesGBuffer.data();  // The clear values (for color and depth)
-      
-      vkCmdBeginRenderPass(cmdBuf, &gBufferRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-      helloVk.gBufferBegin(cmdBuf);
-      vkCmdEndRenderPass(cmdBuf);
-    }
+    // Frame graph: passes declare what they read and write, barriers and culling follow from it
+    frameGraph.begin_frame();
+    helloVk.importGraphResources(frameGraph);
+    const HelloVulkan::GraphResources& res = helloVk.m_graphResources;
+
+    const VkPipelineStageFlags colorStage  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    const VkPipelineStageFlags vertexStage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+    const VkPipelineStageFlags fragStage   = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    const VkPipelineStageFlags rtStage     = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+    const VkAccessFlags        colorWrite  = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    const VkPipelineStageFlags depthStage  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkAccessFlags        depthWrite  = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    const VkAccessFlags        shaderRead  = VK_ACCESS_SHADER_READ_BIT;
+    const VkAccessFlags        shaderWrite = VK_ACCESS_SHADER_WRITE_BIT;
 
 
-    
-    // Indirect Pass
-    {
-      VkRenderPassBeginInfo indirectPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-      indirectPassBeginInfo.clearValueCount = 2;
-      indirectPassBeginInfo.pClearValues    = clearValues.data();
-      indirectPassBeginInfo.renderPass      = helloVk.m_IndirectRenderPass;
-      indirectPassBeginInfo.framebuffer     = helloVk.m_IndirectFramebuffer;
-      indirectPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};
-      if(useIndirect) {
-        helloVk.IndirectBegin(cmdBuf, clearColor, scene);
-      }
+    // Normals GBuffer
+    frameGraph.add_pass("G-Buffer", {},
+                        {{res.gBufferNormals, colorStage, colorWrite}, {res.gBufferDepth, depthStage, depthWrite},
+                         {res.gBufferAlbedo, colorStage, colorWrite}, {res.gBufferDiffuse, colorStage, colorWrite},
+                         {res.gBufferMotion, colorStage, colorWrite}},
+                        [&](VkCommandBuffer cmdBuf) {
+                          VkRenderPassBeginInfo gBufferRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+                          gBufferRenderPassBeginInfo.renderPass      = helloVk.m_gBufferRenderPass;   // The render pass created earlier
+                          gBufferRenderPassBeginInfo.framebuffer     = helloVk.m_gBufferFramebuffer;  // The framebuffer created earlier
+                          gBufferRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};   // The area to render to
+                          gBufferRenderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValuesGBuffer.size());
+                          gBufferRenderPassBeginInfo.pClearValues = clearValuesGBuffer.data();  // The clear values (for color and depth)
+
+                          vkCmdBeginRenderPass(cmdBuf, &gBufferRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+                          helloVk.gBufferBegin(cmdBuf);
+                          vkCmdEndRenderPass(cmdBuf);
+                        });
+
+
+    // Indirect Passes
+    if(useIndirect) {
+      helloVk.addIndirectPasses(frameGraph, clearColor, scene);
     }
 
 
-
     // Offscreen render pass
-    {
-      VkRenderPassBeginInfo offscreenRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-      offscreenRenderPassBeginInfo.clearValueCount = 2;
-      offscreenRenderPassBeginInfo.pClearValues    = clearValues.data();
-      offscreenRenderPassBeginInfo.renderPass      = helloVk.m_offscreenRenderPass;
-      offscreenRenderPassBeginInfo.framebuffer     = helloVk.m_offscreenFramebuffer;
-      offscreenRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};
-
-      // Rendering Scene
-      if(useRaytracer) {
-        helloVk.raytrace(cmdBuf, clearColor);
+    frameGraph.add_pass("Main", {},
+                        {{res.offscreenColor, useRaytracer ? rtStage : colorStage, useRaytracer ? shaderWrite : colorWrite}},
+                        [&](VkCommandBuffer cmdBuf) {
+                          VkRenderPassBeginInfo offscreenRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+                          offscreenRenderPassBeginInfo.clearValueCount = 2;
+                          offscreenRenderPassBeginInfo.pClearValues    = clearValues.data();
+                          offscreenRenderPassBeginInfo.renderPass      = helloVk.m_offscreenRenderPass;
+                          offscreenRenderPassBeginInfo.framebuffer     = helloVk.m_offscreenFramebuffer;
+                          offscreenRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};
+
+                          // Rendering Scene
+                          if(useRaytracer) {
+                            helloVk.raytrace(cmdBuf, clearColor);
+                          } else {
+                            vkCmdBeginRenderPass(cmdBuf, &offscreenRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+                            helloVk.rasterize(cmdBuf);
+                            vkCmdEndRenderPass(cmdBuf);
+                          }
+                        });
+
+
+    // Debug Pass, culled whenever post does not composite it
+    frameGraph.add_pass("Debug Probes",
+                        {{res.offsets, vertexStage, shaderRead}, {res.status, vertexStage, shaderRead},
+                         {res.irradiance, fragStage, shaderRead}, {res.probeSH, fragStage, shaderRead}, {res.gBufferDepth, fragStage, shaderRead}},
+                        {{res.debugColor, colorStage, colorWrite}}, [&](VkCommandBuffer cmdBuf) {
+                          VkRenderPassBeginInfo debugRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+                          debugRenderPassBeginInfo.clearValueCount = 2;
+                          debugRenderPassBeginInfo.pClearValues    = clearValues2.data();
+                          debugRenderPassBeginInfo.renderPass      = helloVk.m_debugRenderPass;
+                          debugRenderPassBeginInfo.framebuffer = helloVk.m_debugFramebuffer;  // Make sure this uses the same depth attachment
+                          debugRenderPassBeginInfo.renderArea = {{0, 0}, helloVk.getSize()};
+
+                          vkCmdBeginRenderPass(cmdBuf, &debugRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+                          helloVk.drawDebug(cmdBuf);
+                          vkCmdEndRenderPass(cmdBuf);
+                        });
 
-      } else {
-        vkCmdBeginRenderPass(cmdBuf, &offscreenRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        helloVk.rasterize(cmdBuf);
 
-        vkCmdEndRenderPass(cmdBuf);
-      }
-    }
-
-    
-    // Debug Pass
-    {
-      VkRenderPassBeginInfo debugRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-      debugRenderPassBeginInfo.clearValueCount = 2;  
-      debugRenderPassBeginInfo.pClearValues    = clearValues2.data();
-      debugRenderPassBeginInfo.renderPass      = helloVk.m_debugRenderPass;
-      debugRenderPassBeginInfo.framebuffer = helloVk.m_debugFramebuffer;  // Make sure this uses the same depth attachment
-      debugRenderPassBeginInfo.renderArea = {{0, 0}, helloVk.getSize()};
-
-      if(scene.gi_show_probes)
-      {
-        vkCmdBeginRenderPass(cmdBuf, &debugRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        helloVk.drawDebug(cmdBuf);
-        vkCmdEndRenderPass(cmdBuf);
+    // 2nd rendering pass: tone mapper, UI
+    std::vector<Frame_Graph::Access> postReads{{res.offscreenColor, fragStage, shaderRead}};
+    if(useIndirect) {
+      postReads.push_back({helloVk.isTemporalAccumulating() ? res.indirectHistory[helloVk.getTemporalOutput()] : res.indirect, fragStage, shaderRead});
+      postReads.push_back({res.gBufferAlbedo, fragStage, shaderRead});
+      postReads.push_back({res.gBufferDiffuse, fragStage, shaderRead});
+      if(scene.gi_show_probes) {
+        postReads.push_back({res.debugColor, fragStage, shaderRead});
       }
     }
-
-
-    
-    // 2nd rendering pass: tone mapper, UI
-    {
-      VkRenderPassBeginInfo postRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-      postRenderPassBeginInfo.clearValueCount = 2;
-      postRenderPassBeginInfo.pClearValues    = clearValues.data();
-      postRenderPassBeginInfo.renderPass      = helloVk.getRenderPass();
-      postRenderPassBeginInfo.framebuffer     = helloVk.getFramebuffers()[curFrame];
-      postRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};
-
-      // Rendering tonemapper
-      vkCmdBeginRenderPass(cmdBuf, &postRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-      helloVk.drawPost(cmdBuf, useIndirect, scene.gi_show_probes);
-      // Rendering UI
-      ImGui::Render();
-      ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuf);
-      vkCmdEndRenderPass(cmdBuf);
+    if(helloVk.volume.m_showDebugTextures) {
+      // Same order as the global textures array
+      const std::array<uint32_t, 12> debugTextures{res.radiance,       res.offsets,            res.irradiance,
+                                                   res.visibility,     res.gBufferNormals,     res.gBufferDepth,
+                                                   res.indirect,       res.gBufferAlbedo,      res.gBufferDiffuse,
+                                                   res.gBufferMotion,  res.indirectHistory[0], res.indirectHistory[1]};
+      postReads.push_back({debugTextures[helloVk.volume.m_currentTextureDebug], fragStage, shaderRead});
     }
-    
-    
 
+    frameGraph.add_pass("Post", postReads, {}, [&](VkCommandBuffer cmdBuf) {
+          VkRenderPassBeginInfo postRenderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+          postRenderPassBeginInfo.clearValueCount = 2;
+          postRenderPassBeginInfo.pClearValues    = clearValues.data();
+          postRenderPassBeginInfo.renderPass      = helloVk.getRenderPass();
+          postRenderPassBeginInfo.framebuffer     = helloVk.getFramebuffers()[curFrame];
+          postRenderPassBeginInfo.renderArea      = {{0, 0}, helloVk.getSize()};
+
+          // Rendering tonemapper
+          vkCmdBeginRenderPass(cmdBuf, &postRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+          helloVk.drawPost(cmdBuf, useIndirect, scene.gi_show_probes);
+          // Rendering UI
+          ImGui::Render();
+          ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuf);
+          vkCmdEndRenderPass(cmdBuf);
+        }, true);
 
     // Submit for display
-    vkEndCommandBuffer(cmdBuf);
-    helloVk.submitFrame();
+    frameGraph.compile();
+    if(frameGraph.has_async_passes()) {
+      const HelloVulkan::AsyncFrame& asyncFrame = helloVk.m_asyncFrames[curFrame];
+
+      vkBeginCommandBuffer(asyncFrame.traceCmdBuf, &beginInfo);
+      frameGraph.execute(asyncFrame.traceCmdBuf, Frame_Graph::BATCH_BEFORE_ASYNC);
+      vkEndCommandBuffer(asyncFrame.traceCmdBuf);
+
+      // The async batch is timed with the valid timestamp bits of the compute family
+      vkBeginCommandBuffer(asyncFrame.computeCmdBuf, &beginInfo);
+      profiler.set_queue_family(vkctx.m_queueC.familyIndex);
+      frameGraph.execute(asyncFrame.computeCmdBuf, Frame_Graph::BATCH_ASYNC);
+      profiler.set_queue_family(vkctx.m_queueGCT.familyIndex);
+      vkEndCommandBuffer(asyncFrame.computeCmdBuf);
+
+      frameGraph.execute(cmdBuf, Frame_Graph::BATCH_AFTER_ASYNC);
+      vkEndCommandBuffer(cmdBuf);
+      helloVk.submitAsyncFrame();
+    } else {
+      frameGraph.execute(cmdBuf);
+      vkEndCommandBuffer(cmdBuf);
+      helloVk.submitFrame();
+    }
   }
 
   // Cleanup
   vkDeviceWaitIdle(helloVk.getDevice());
 
+  profiler.destroy();
   helloVk.destroyResources();
   helloVk.destroy();
   vkctx.deinit();
@@ -12,9 +12,25 @@ C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 D:\RayTracing\NVPro\
 :: Compute Shaders
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeOffsets.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeOffsets.glsl.spv
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeStatus.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeStatus.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeScroll.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeScroll.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probePriority.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probePriority.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeThreshold.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeThreshold.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeCompact.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeCompact.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeDirections.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeDirections.glsl.spv
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateIrradiance.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateIrradiance.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute -DCOMPACT_ATLASES D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateIrradiance.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateIrradiance_compact.glsl.spv
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateVisibility.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateVisibility.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute -DCOMPACT_ATLASES D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateVisibility.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateVisibility_compact.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateFused.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateFused.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute -DCOMPACT_ATLASES D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateFused.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateFused_compact.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeUpdateSH.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeUpdateSH.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeBorder.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeBorder.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute -DCOMPACT_ATLASES D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\probeBorder.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\probeBorder_compact.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\sampleClassify.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\sampleClassify.glsl.spv
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\sampleIrradiance.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\sampleIrradiance.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute -DSAMPLE_COHERENT D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\sampleIrradiance.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\sampleIrradiance_coherent.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\indirectUpsample.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\indirectUpsample.glsl.spv
+C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 -fshader-stage=compute D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\indirectTemporal.glsl -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\indirectTemporal.glsl.spv
 
 :: GBuffer Files
 C:\VulkanSDK\1.3.275.0\Bin\glslc.exe --target-env=vulkan1.2 D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\shaders\gBufferVertex.vert -o D:\RayTracing\NVPro\vk_raytracing_tutorial_KHR\ray_tracing__simple\spv\gBufferVertex.vert.spv
@@ -24,13 +24,19 @@ layout(set = 1, binding = eGlobals) uniform _GlobalUniforms { GlobalUniforms uni
 
 void main() {    
 
-    vec2 uv = get_probe_uv(normal_edge_factor.xyz, probe_index, irradiance_texture_width, irradiance_texture_height, irradiance_side_length);
+    vec3 irradiance;
+    if ( use_sh_irradiance() ) {
+        irradiance = evaluate_probe_sh(probe_index, normalize(normal_edge_factor.xyz));
+    }
+    else {
+        vec3 uv = get_probe_uv(normal_edge_factor.xyz, probe_index, irradiance_texture_width, irradiance_texture_height, irradiance_side_length);
 
-    vec3 irradiance = textureLod(global_textures[nonuniformEXT(grid_irradiance_output_index)], uv, 0).rgb;
+        irradiance = textureLod(probe_textures[PROBE_IRRADIANCE_TEXTURE], uv, 0).rgb;
 
-    if ( use_perceptual_encoding() ) {
-        irradiance = pow(irradiance, vec3(0.5f * 5.0f));
-        irradiance = irradiance * irradiance;
+        if ( use_perceptual_encoding() ) {
+            irradiance = pow(irradiance, vec3(0.5f * 5.0f));
+            irradiance = irradiance * irradiance;
+        }
     }
 
     /*
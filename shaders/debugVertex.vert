@@ -32,10 +32,10 @@ void main() {
     probe_index = gl_InstanceIndex;
     probe_status = probe_statuses[ probe_index ];
 
-    const ivec3 probe_grid_indices = probe_index_to_grid_indices(int(probe_index));
-    const vec3 probe_position = grid_indices_to_world( probe_grid_indices, probe_index );
+    const vec3 probe_position = get_probe_world_position( probe_index );
+    const float volume_scale = probe_volumes[ get_probe_volume( probe_index ) ].spacing.w;
     
-    gl_Position = uni.projection * uni.view  * vec4( (pos * probe_sphere_scale) + probe_position, 1.0 );
+    gl_Position = uni.projection * uni.view  * vec4( (pos * probe_sphere_scale * volume_scale) + probe_position, 1.0 );
 
     normal_edge_factor.xyz = normalize( pos );
     normal_edge_factor.w = abs(dot(normal_edge_factor.xyz, normalize(probe_position - camera_position.xyz)));
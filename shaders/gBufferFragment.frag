@@ -21,12 +21,14 @@ layout(location = 1) in vec3 i_worldPos;
 layout(location = 2) in vec3 i_worldNrm;
 layout(location = 3) in vec3 i_viewDir;
 layout(location = 4) in vec2 i_texCoord;
+layout(location = 5) in vec4 i_clipPos;
+layout(location = 6) in vec4 i_prevClipPos;
 
 // Outgoing
 layout(location = 0) out vec4 o_normals;
-layout(location = 1) out vec4 o_depth;
-layout(location = 2) out vec4 o_albedo;
-layout(location = 3) out vec4 o_diffuseLight;
+layout(location = 1) out vec4 o_albedo;
+layout(location = 2) out vec4 o_diffuseLight;
+layout(location = 3) out vec4 o_motion;
 
 
 
@@ -64,14 +66,15 @@ vec2 oct_encode(in vec3 v) {
 
 
 void main() {
-    // Normals
+    // Normals, only the octahedral xy survive the RG16F target
 	o_normals = vec4(oct_encode(i_worldNrm), 0.0, 1.0);
 
-    // Depth Map
-	vec4 clipPos = uni.viewProj * vec4(i_worldPos, 1.0);
-	vec3 ndcPos = clipPos.xyz / clipPos.w;
-	float normalizedDepth = (ndcPos.z + 1.0) * 0.5;
-	o_depth = vec4(normalizedDepth, normalizedDepth, normalizedDepth, 1.0);
+    // Depth comes from the depth attachment, sampled directly by the indirect passes
+
+    // Motion vectors, screen uv of this frame minus the one of the previous frame
+    vec2 uv      = (i_clipPos.xy / i_clipPos.w) * 0.5 + 0.5;
+    vec2 prevUv  = (i_prevClipPos.xy / i_prevClipPos.w) * 0.5 + 0.5;
+    o_motion     = vec4(uv - prevUv, 0.0, 0.0);
 
 
 
@@ -25,6 +25,8 @@ layout(location = 1) out vec3 o_worldPos;
 layout(location = 2) out vec3 o_worldNrm;
 layout(location = 3) out vec3 o_viewDir;
 layout(location = 4) out vec2 o_texCoord;
+layout(location = 5) out vec4 o_clipPos;
+layout(location = 6) out vec4 o_prevClipPos;
 
 out gl_PerVertex {
   vec4 gl_Position;
@@ -41,4 +43,8 @@ void main()
   o_worldNrm = mat3(pcRaster.modelMatrix) * i_normal;
 
   gl_Position = uni.viewProj * vec4(o_worldPos, 1.0);
+
+  // Instances never move, only the camera does: the previous position is the same world position seen by last frame's camera
+  o_clipPos     = gl_Position;
+  o_prevClipPos = uni.prevViewProj * vec4(o_worldPos, 1.0);
 }
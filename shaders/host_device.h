@@ -38,7 +38,13 @@ START_BINDING(RtxBindings)
   eStorageImages = 4,	// Storage Images
   eGlobalTextures = 5,	// Global Textures
   eIrradianceImage = 6,	// Irradiance Image for Probe Update
-  eVisibilityImage = 7  // Visibility Image for Probe Update
+  eVisibilityImage = 7,	// Visibility Image for Probe Update
+  eActiveProbes = 8,	// Compacted active probes and their indirect arguments
+  eProbeSchedule = 9,	// Priority histogram and per probe scheduling state
+  eRayDirections = 10,	// Ray direction table of the frame
+  eSampleTiles = 11,	// Classified tiles of the irradiance sampling and their indirect arguments
+  eOffsetsImage = 12,	// Probe offsets array for the offset and scroll passes
+  eProbeTextures = 13	// Offsets, irradiance and visibility arrays, sampled
 END_BINDING();
 
  // clang-format on
@@ -51,6 +57,7 @@ struct ObjDesc {
   uint64_t indexAddress;          // Address of the index buffer
   uint64_t materialAddress;       // Address of the material buffer
   uint64_t materialIndexAddress;  // Address of the triangle material index buffer
+  uint64_t surfaceAddress;        // Address of the per triangle surface cache, 0 when the model has none
 };
 
 // Uniform buffer set at each frame
@@ -60,6 +67,7 @@ struct GlobalUniforms {
   mat4 projInverse;  // Camera inverse projection matrix
   mat4 view;
   mat4 projection;
+  mat4 prevViewProj;  // Camera view * projection of the previous frame, for the motion vectors
   vec3 position;
 };
 
@@ -79,14 +87,25 @@ struct PushConstantDebug {
 
 struct PushConstantOffset {
   uint first_frame;
+  uint update_all;  // Relocate every traced probe, otherwise only the ones still relocating after a scroll
 };
 
 struct PushConstantStatus {
   uint first_frame;
 };
 
+struct PushConstantSchedule {
+  uint keep_all;  // Schedule every probe regardless of priority and status, e.g. while the offsets are being placed
+};
+
 struct PushConstantSample {
-  uint output_resolution_half;
+  uint resolution_divider;  // Irradiance is sampled once per divider x divider pixels, then upsampled. 1, 2 or 4.
+  int  sample_rotation;     // Pixel of each block sampled this frame while accumulating temporally, -1 for the farthest one
+  uint tile_list;           // Workgroups take their tile from the classified list, otherwise from their id
+};
+
+struct PushConstantTemporal {
+  uint reset;  // Drop the history, e.g. on the first accumulated frame
 };
 
 
@@ -97,9 +116,82 @@ struct PushConstantPost {
   uint  debug_texture;
   uint  show_textures;
   float aspectRatio;
+  uint  indirect_texture;  // Global texture holding the final indirect lighting, the accumulated history when temporal
+};
+
+
+
+// Header of the active probes buffer, the packed probe indices follow it.
+// Written by the scheduling passes, consumed by vkCmdTraceRaysIndirectKHR and vkCmdDispatchIndirect.
+struct ProbeIndirectArgs {
+  uint trace_width;   // VkTraceRaysIndirectCommandKHR: largest ray count of the active probes
+  uint trace_height;  // Active probes
+  uint trace_depth;
+  uint blend_x;       // VkDispatchIndirectCommand: one workgroup per active probe
+  uint blend_y;
+  uint blend_z;
+  uint probe_x;       // VkDispatchIndirectCommand: one thread per active probe, 32 wide workgroups
+  uint probe_y;
+  uint probe_z;
+  uint threshold_bucket;  // Lowest priority bucket that made it into the list
+  uint tie_budget;        // Probes of the threshold bucket that still fit the budget
+  uint tie_count;
+  uint cursor;            // Next free slot of the list while compacting
+  uint pad0;
+  uint pad1;
+  uint pad2;
 };
 
+// Header of the sample tiles buffer, followed by the coherent tile list and, sample_tile_capacity entries later, the mixed one.
+// Written by the classification dispatch of the sampling pass, consumed by its vkCmdDispatchIndirect.
+struct SampleTileArgs {
+  uint coherent_x;  // VkDispatchIndirectCommand: one workgroup per tile whose pixels all sample the same probe cage
+  uint coherent_y;
+  uint coherent_z;
+  uint mixed_x;     // VkDispatchIndirectCommand: one workgroup per tile spanning several cages or volumes
+  uint mixed_y;
+  uint mixed_z;
+  uint sky_count;   // Tiles without any surface, written by the classification itself
+  uint sample_tile_capacity;
+};
 
+// Pixels of the reduced resolution sampled by one workgroup, along each side
+#define SAMPLE_TILE_SIZE 8
+
+// Most rays a probe can trace, sizes the shared memory staging of the blend passes
+#define PROBE_MAX_RAYS 256
+// Ray counts are whole multiples of this, one direction set per count is kept in the ray direction table
+#define PROBE_RAY_GRANULARITY 32
+#define PROBE_RAY_TABLE_SIZE (PROBE_RAY_GRANULARITY * (PROBE_MAX_RAYS / PROBE_RAY_GRANULARITY) * (PROBE_MAX_RAYS / PROBE_RAY_GRANULARITY + 1) / 2)
+
+// Probes are ranked by bucketing their priority, the budget is filled from the highest bucket down
+#define PROBE_PRIORITY_BUCKETS 256
+#define PROBE_NOT_SCHEDULED 0xFFFFFFFFu
+
+// Probe cascades, each twice the spacing of the previous one and stacked along z in every per probe resource
+#define PROBE_MAX_CASCADES 4
+
+// Probe volumes: extra grids placed by hand plus the cascades of the main grid, each with its own counts, spacing and rays
+#define PROBE_MAX_VOLUMES 8
+
+// Frames of offset relocation for a newly placed probe, the whole grid after a full placement, a single probe after a scroll
+#define PROBE_RELOCATION_FRAMES 24
+
+// L1 spherical harmonics irradiance, one texel per coefficient in the probe's row of the SH image
+#define PROBE_SH_COEFFICIENTS 4
+
+// Per probe scheduling state, persistent across frames
+struct ProbeScheduleInfo {
+  uint  age;                 // Frames since the probe was last traced
+  uint  bucket;              // Priority bucket of this frame, PROBE_NOT_SCHEDULED when skipped
+  float irradiance_change;   // Mean change of the last irradiance blend
+  uint  ray_count;           // Rays traced for the probe this frame, the first ray_count texels of its radiance row
+  float luminance_mean;      // Running mean of the traced ray luminance
+  float luminance_variance;  // Running variance of the traced ray luminance
+  uint  has_statistics;      // Set once the luminance statistics hold a measurement
+  uint  reset;               // Traced frames left relocating a probe that took over a slot, from PROBE_RELOCATION_FRAMES.
+                             // Its first blend ignores the history.
+};
 
 // Push constant structure for the ray tracer
 struct PushConstantRay {
@@ -129,5 +221,11 @@ struct WaveFrontMaterial { // See ObjLoader, copy of MaterialObj, could be compr
   int   textureId;
 };
 
+struct SurfaceRecord { // Per triangle surface cache, what a probe ray hit reads instead of the vertices, material and texture
+  uint albedo;   // Diffuse colour times the prefiltered texture, sqrt encoded RGBA8
+  uint ambient;  // Ambient colour times the prefiltered texture, sqrt encoded RGBA8
+  uint normal;   // Object space normal at the centroid, octahedral SNORM16x2
+};
+
 
 #endif
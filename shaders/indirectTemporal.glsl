@@ -0,0 +1,100 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(push_constant) uniform _PushConstantTemporal {
+  PushConstantTemporal pcTemporal;
+};
+
+layout(set = 1, binding = eGlobals) uniform _GlobalUniforms{ GlobalUniforms uni; };
+
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+
+// Relative view depth difference at which a history texel is taken as another surface, and sharpness of the normal test
+const float TEMPORAL_DEPTH_TOLERANCE = 0.05f;
+const float TEMPORAL_NORMAL_POWER    = 16.0f;
+
+vec3 get_view_position(ivec2 pixel, float raw_depth) {
+  const vec2 ndc        = uv_nearest(pixel, resolution) * 2.0 - 1.0;
+  const vec4 view_space = uni.projInverse * vec4(ndc, raw_depth, 1.0);
+  return view_space.xyz / view_space.w;
+}
+
+
+// Accumulates this frame's indirect lighting into the history of the previous frames.
+// The history is fetched where the G-buffer motion vectors say the pixel was last frame, each of its four bilinear
+// texels only counting when the guide stored with it matches the surface: the view depth the pixel's world position had
+// last frame, and its normal. Disoccluded pixels start over from this frame's value.
+void main() {
+  const ivec2 full_size = ivec2(resolution);
+  const ivec2 pixel     = ivec2(gl_GlobalInvocationID.xy);
+  if(any(greaterThanEqual(pixel, full_size))) {
+    return;
+  }
+
+  const vec3  current   = imageLoad(global_images_2d[indirect_output_index], pixel).rgb;
+  const float raw_depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], pixel, 0).r;
+  if(raw_depth == 1.0) {
+    imageStore(global_images_2d[indirect_history_output_index], pixel, vec4(current, 1.0));
+    imageStore(global_images_2d[indirect_guide_output_index], pixel, vec4(0.0));
+    return;
+  }
+
+  const vec3 view_position  = get_view_position(pixel, raw_depth);
+  const vec3 world_position = (uni.viewInverse * vec4(view_position, 1.0)).xyz;
+  const vec2 encoded_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], pixel, 0).rg;
+  const vec3 normal         = normalize(oct_decode(encoded_normal));
+
+  // Depth the surface had from last frame's camera, w of its clip position
+  const float previous_depth = (uni.prevViewProj * vec4(world_position, 1.0)).w;
+
+  vec4  history        = vec4(0.0f);
+  float history_weight = 0.0f;
+
+  const vec2 previous_uv = uv_nearest(pixel, resolution) - texelFetch(global_textures[nonuniformEXT(motion_texture_index)], pixel, 0).rg;
+  if(pcTemporal.reset == 0 && all(greaterThanEqual(previous_uv, vec2(0.0))) && all(lessThan(previous_uv, vec2(1.0)))) {
+    // Bilinear footprint of the previous position in the history
+    const vec2  previous_position = previous_uv * resolution - 0.5;
+    const ivec2 base              = ivec2(floor(previous_position));
+    const vec2  alpha             = previous_position - vec2(base);
+
+    for(int i = 0; i < 4; ++i) {
+      const ivec2 offset = ivec2(i, i >> 1) & ivec2(1);
+      const ivec2 tap    = clamp(base + offset, ivec2(0), full_size - ivec2(1));
+      const vec4  guide  = imageLoad(global_images_2d[nonuniformEXT(indirect_guide_index)], tap);
+      // Sky, or nothing accumulated yet
+      if(guide.z <= 0.0) {
+        continue;
+      }
+
+      const vec2  bilinear       = mix(1.0 - alpha, alpha, vec2(offset));
+      const float depth_distance = abs(guide.z - previous_depth) / previous_depth;
+      const float depth_weight   = max(0.0f, 1.0f - depth_distance / TEMPORAL_DEPTH_TOLERANCE);
+      const float normal_weight  = pow(max(dot(normal, normalize(oct_decode(guide.xy))), 0.0f), TEMPORAL_NORMAL_POWER);
+      const float weight         = bilinear.x * bilinear.y * depth_weight * normal_weight;
+
+      history += weight * imageLoad(global_images_2d[nonuniformEXT(indirect_history_index)], tap);
+      history_weight += weight;
+    }
+  }
+
+  // Running average over the history length, capped so the result keeps following lighting changes
+  vec3  irradiance     = current;
+  float history_length = 1.0f;
+  if(history_weight > 1e-3f) {
+    history /= history_weight;
+    history_length = min(history.a + 1.0f, temporal_max_history);
+    irradiance     = mix(history.rgb, current, 1.0f / history_length);
+  }
+
+  imageStore(global_images_2d[indirect_history_output_index], pixel, vec4(irradiance, history_length));
+  imageStore(global_images_2d[indirect_guide_output_index], pixel, vec4(encoded_normal, -view_position.z, 0.0));
+}
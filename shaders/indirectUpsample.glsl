@@ -0,0 +1,99 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(push_constant) uniform _PushConstantSample {
+  PushConstantSample pcSample;
+};
+
+layout(set = 1, binding = eGlobals) uniform _GlobalUniforms{ GlobalUniforms uni; };
+
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+
+// Relative view depth difference at which a low resolution sample stops counting, and sharpness of the normal test
+const float UPSAMPLE_DEPTH_TOLERANCE = 0.1f;
+const float UPSAMPLE_NORMAL_POWER    = 8.0f;
+
+float get_view_depth(ivec2 pixel, float raw_depth) {
+  const vec2 ndc        = uv_nearest(pixel, resolution) * 2.0 - 1.0;
+  const vec4 view_space = uni.projInverse * vec4(ndc, raw_depth, 1.0);
+  return abs(view_space.z / view_space.w);
+}
+
+vec3 get_normal(ivec2 pixel) {
+  return normalize(oct_decode(texelFetch(global_textures[nonuniformEXT(normal_texture_index)], pixel, 0).rg));
+}
+
+
+// Joint bilateral upsample of the reduced resolution irradiance into the full resolution indirect image.
+// The four low resolution texels around a pixel are weighed bilinearly, then by how close the pixel each one was
+// sampled at is in view depth and normal, so irradiance never crosses a depth or orientation edge.
+void main() {
+  const int   resolution_divider = int(pcSample.resolution_divider);
+  const ivec2 full_size          = ivec2(resolution);
+  const ivec2 low_size           = (full_size + resolution_divider - 1) / resolution_divider;
+
+  const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if(any(greaterThanEqual(pixel, full_size))) {
+    return;
+  }
+
+  const float raw_depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], pixel, 0).r;
+  if(raw_depth == 1.0) {
+    imageStore(global_images_2d[indirect_output_index], pixel, vec4(0, 0, 0, 1));
+    return;
+  }
+  const float depth  = get_view_depth(pixel, raw_depth);
+  const vec3  normal = get_normal(pixel);
+
+  // Bilinear footprint of the pixel in the low resolution image
+  const vec2  low_position = (vec2(pixel) + 0.5) / float(resolution_divider) - 0.5;
+  const ivec2 base         = ivec2(floor(low_position));
+  const vec2  alpha        = low_position - vec2(base);
+
+  vec3  sum_irradiance = vec3(0.0f);
+  float sum_weight     = 0.0f;
+
+  // Closest tap in depth, kept for pixels no tap agrees with, e.g. thin features missed at the low resolution
+  vec3  fallback_irradiance = vec3(0.0f);
+  float fallback_distance   = 1e30f;
+
+  for(int i = 0; i < 4; ++i) {
+    const ivec2 offset = ivec2(i, i >> 1) & ivec2(1);
+    const ivec2 tap    = clamp(base + offset, ivec2(0), low_size - ivec2(1));
+    const vec4  low    = imageLoad(global_images_2d[nonuniformEXT(indirect_low_res_index)], tap);
+    // Sky block
+    if(low.a < 0.0) {
+      continue;
+    }
+
+    const int   sample_index = int(low.a);
+    const ivec2 tap_pixel    = tap * resolution_divider + ivec2(sample_index % resolution_divider, sample_index / resolution_divider);
+    const float tap_depth    = get_view_depth(tap_pixel, texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], tap_pixel, 0).r);
+
+    const vec2  bilinear       = mix(1.0 - alpha, alpha, vec2(offset));
+    const float depth_distance = abs(tap_depth - depth) / depth;
+    const float depth_weight   = max(0.0f, 1.0f - depth_distance / UPSAMPLE_DEPTH_TOLERANCE);
+    const float normal_weight  = pow(max(dot(normal, get_normal(tap_pixel)), 0.0f), UPSAMPLE_NORMAL_POWER);
+    const float weight         = bilinear.x * bilinear.y * depth_weight * normal_weight;
+
+    sum_irradiance += weight * low.rgb;
+    sum_weight += weight;
+
+    if(depth_distance < fallback_distance) {
+      fallback_distance   = depth_distance;
+      fallback_irradiance = low.rgb;
+    }
+  }
+
+  const vec3 irradiance = sum_weight > 1e-4f ? sum_irradiance / sum_weight : fallback_irradiance;
+  imageStore(global_images_2d[indirect_output_index], pixel, vec4(irradiance, 1.0));
+}
@@ -25,6 +25,7 @@ layout(push_constant) uniform shaderInformation {
     uint debugTexture;
     uint show_textures;
 	float aspectRatio;
+    uint indirectTexture;
 } pushc;
 
 
@@ -39,7 +40,7 @@ void main() {
         vec4 diffuseColour = texture(global_textures[8], uv).rgba;
         vec4 albedo = texture(global_textures[7], uv).rgba;
 
-        vec4 indirectColor = texture(global_textures[6], uv).rgba * albedo;
+        vec4 indirectColor = texture(global_textures[pushc.indirectTexture], uv).rgba * albedo;
 
 
         vec4 blendedColor;
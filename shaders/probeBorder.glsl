@@ -0,0 +1,143 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(IRRADIANCE_IMAGE_FORMAT, set = 0, binding = eIrradianceImage) uniform image2DArray irradiance_image;
+layout(VISIBILITY_IMAGE_FORMAT, set = 0, binding = eVisibilityImage) uniform image2DArray visibility_image;
+
+layout(std430, set = 0, binding = eActiveProbes) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+int k_read_table[6] = {5, 3, 1, -1, -3, -5};
+
+// Border texel of a probe tile: the top row, the bottom row, then the left and right columns without their corners
+ivec2 get_border_pixel(int border_index, int probe_with_border_side) {
+  const int probe_last_pixel = probe_with_border_side - 1;
+  if(border_index < probe_with_border_side) {
+    return ivec2(border_index, 0);
+  }
+  border_index -= probe_with_border_side;
+  if(border_index < probe_with_border_side) {
+    return ivec2(border_index, probe_last_pixel);
+  }
+  border_index -= probe_with_border_side;
+  const int column_length = probe_with_border_side - 2;
+  if(border_index < column_length) {
+    return ivec2(0, border_index + 1);
+  }
+  return ivec2(probe_last_pixel, border_index - column_length + 1);
+}
+
+// Interior texel a border texel copies, so bilinear filtering wraps around the octahedral map
+ivec2 get_border_source(ivec2 coords, ivec2 probe_pixel, int probe_side_length) {
+  const int probe_last_pixel = probe_side_length + 1;
+
+  bool corner_pixel = (probe_pixel.x == 0 || probe_pixel.x == probe_last_pixel) && (probe_pixel.y == 0 || probe_pixel.y == probe_last_pixel);
+  bool row_pixel    = (probe_pixel.x > 0 && probe_pixel.x < probe_last_pixel);
+
+  ivec2 source_pixel_coordinate = coords;
+
+  if(corner_pixel) {
+    source_pixel_coordinate.x += probe_pixel.x == 0 ? probe_side_length : -probe_side_length;
+    source_pixel_coordinate.y += probe_pixel.y == 0 ? probe_side_length : -probe_side_length;
+
+    if(show_border_type()) {
+      source_pixel_coordinate = ivec2(2, 2);
+    }
+  }
+  else if(row_pixel) {
+    source_pixel_coordinate.x += k_read_table[probe_pixel.x - 1];
+    source_pixel_coordinate.y += (probe_pixel.y > 0) ? -1 : 1;
+
+    if(show_border_type()) {
+      source_pixel_coordinate = ivec2(3, 3);
+    }
+  }
+  else {
+    source_pixel_coordinate.x += (probe_pixel.x > 0) ? -1 : 1;
+    source_pixel_coordinate.y += k_read_table[probe_pixel.y - 1];
+
+    if(show_border_type()) {
+      source_pixel_coordinate = ivec2(4, 4);
+    }
+  }
+  return source_pixel_coordinate;
+}
+
+
+// Copies the border texels of the probes blended this frame, in both atlases.
+// One workgroup per active probe, each thread walks the border of the tile with a stride of the workgroup.
+// The sources are interior texels only, so nothing in here reads what another thread writes.
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  const int probe_index = active_probes[gl_WorkGroupID.x];
+
+  // Irradiance
+  const int irradiance_with_border_side = irradiance_side_length + 2;
+  const int irradiance_border_texels    = 4 * irradiance_with_border_side - 4;
+  const ivec3 irradiance_top_left       = get_probe_atlas_top_left(probe_index, irradiance_with_border_side);
+
+  for(int border_index = int(gl_LocalInvocationID.x); border_index < irradiance_border_texels; border_index += 32) {
+    const ivec2 probe_pixel = get_border_pixel(border_index, irradiance_with_border_side);
+    const ivec2 coords      = irradiance_top_left.xy + probe_pixel;
+    const ivec2 source      = get_border_source(coords, probe_pixel, irradiance_side_length);
+
+    vec4 copied_data = imageLoad(irradiance_image, ivec3(source, irradiance_top_left.z));
+
+    // Debug border source coordinates
+    if(show_border_source_coordinates()) {
+      copied_data = vec4(coords, source);
+    }
+
+    // Debug border with color red
+    if(show_border_vs_inside()) {
+      copied_data = vec4(1, 0, 0, 1);
+    }
+
+    imageStore(irradiance_image, ivec3(coords, irradiance_top_left.z), copied_data);
+  }
+
+  // Visibility
+  const int visibility_with_border_side = visibility_side_length + 2;
+  const int visibility_border_texels    = 4 * visibility_with_border_side - 4;
+  const ivec3 visibility_top_left       = get_probe_atlas_top_left(probe_index, visibility_with_border_side);
+
+  for(int border_index = int(gl_LocalInvocationID.x); border_index < visibility_border_texels; border_index += 32) {
+    const ivec2 probe_pixel = get_border_pixel(border_index, visibility_with_border_side);
+    const ivec2 coords      = visibility_top_left.xy + probe_pixel;
+    const ivec2 source      = get_border_source(coords, probe_pixel, visibility_side_length);
+
+    vec4 copied_data = imageLoad(visibility_image, ivec3(source, visibility_top_left.z));
+
+    // Debug border source coordinates
+    if(show_border_source_coordinates()) {
+      copied_data = vec4(coords, source);
+    }
+
+    // Debug border with color red
+    if(show_border_vs_inside()) {
+      copied_data = vec4(1, 0, 0, 1);
+    }
+
+    imageStore(visibility_image, ivec3(coords, visibility_top_left.z), copied_data);
+  }
+
+  // Last pass over the probes blended this frame, from here on their history counts
+  if(gl_LocalInvocationID.x == 0 && probe_schedule[probe_index].reset > 0) {
+    --probe_schedule[probe_index].reset;
+  }
+}
@@ -0,0 +1,47 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(std430, set = 0, binding = eActiveProbes) buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+// Packs the probes picked by the threshold pass: everything above the threshold bucket,
+// and the first probes of the threshold bucket until the budget is used up
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
+
+  int       probe_index  = coords.x;
+  const int total_probes = get_total_probe_count();
+  if(probe_index >= total_probes) {
+    return;
+  }
+
+  const uint bucket = probe_schedule[probe_index].bucket;
+  if(bucket == PROBE_NOT_SCHEDULED || bucket < active_args.threshold_bucket) {
+    return;
+  }
+  if(bucket == active_args.threshold_bucket && atomicAdd(active_args.tie_count, 1) >= active_args.tie_budget) {
+    return;
+  }
+
+  const uint slot     = atomicAdd(active_args.cursor, 1);
+  active_probes[slot] = probe_index;
+  atomicMax(active_args.trace_width, probe_schedule[probe_index].ray_count);
+
+  probe_schedule[probe_index].age = 0;
+}
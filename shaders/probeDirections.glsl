@@ -0,0 +1,33 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(std430, set = 0, binding = eRayDirections) writeonly buffer RayDirectionsSSBO {
+  vec4 ray_directions[PROBE_RAY_TABLE_SIZE];
+};
+
+
+// Fills the ray direction table of the frame, one thread per entry.
+// Every probe pass reads its directions from here instead of evaluating the fibonacci spiral per ray.
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  const int entry = int(gl_GlobalInvocationID.x);
+  if(entry >= PROBE_RAY_TABLE_SIZE) {
+    return;
+  }
+
+  // Ray count of the entry, the table holds PROBE_MAX_RAYS / PROBE_RAY_GRANULARITY of them
+  int ray_count = PROBE_RAY_GRANULARITY;
+  while(get_ray_table_offset(ray_count + PROBE_RAY_GRANULARITY) <= entry) {
+    ray_count += PROBE_RAY_GRANULARITY;
+  }
+  const int ray_index = entry - get_ray_table_offset(ray_count);
+
+  ray_directions[entry] = vec4(normalize(mat3(random_rotation) * spherical_fibonacci(ray_index, ray_count)), 0.0f);
+}
@@ -5,6 +5,7 @@
 
 //#include "host_device.h"
 #include "probeUtil.glsl"
+#include "probeRayDirections.glsl"
 
 
 layout(push_constant) uniform _PushConstantOffset {
@@ -15,6 +16,16 @@ layout(std430, set = 0, binding = eStatus) buffer ProbeStatusSSBO {
   uint probe_status[];
 };
 
+layout(std430, set = 0, binding = eActiveProbes) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) readonly buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
 
 layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
 
@@ -22,12 +33,15 @@ void main() {
   uint  first_frame = pcStatus.first_frame;
   ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
 
-  // Invoke this shader for each probe
-  int       probe_index  = coords.x;
-  const int total_probes = probe_counts.x * probe_counts.y * probe_counts.z;
+  // Invoke this shader for each probe traced this frame
+  if(uint(coords.x) >= active_args.trace_height) {
+    return;
+  }
+  int probe_index = active_probes[coords.x];
+  int ray_count   = int(probe_schedule[probe_index].ray_count);
 
-  // Early out if index is not valid
-  if(probe_index >= total_probes) {
+  // Outside a full placement only the probes exposed by a scroll move, the rest keep their offset
+  if(pcStatus.update_all == 0 && probe_schedule[probe_index].reset == 0) {
     return;
   }
 
@@ -42,7 +56,7 @@ void main() {
 
   int backfaces_count = 0;
   // For each ray cache front/backfaces index and distances.
-  for(int ray_index = 0; ray_index < probe_rays; ++ray_index) {
+  for(int ray_index = 0; ray_index < ray_count; ++ray_index) {
 
     ivec2 ray_tex_coord = ivec2(ray_index, probe_index);
 
@@ -70,24 +84,25 @@ void main() {
   }
 
   vec3 full_offset       = vec3(10000.f);
-  vec3 cell_offset_limit = max_probe_offset * probe_spacing;
+  vec3 cell_offset_limit = max_probe_offset * get_volume_spacing(get_probe_volume(probe_index));
+
+  // One texel per atlas tile
+  const ivec3 probe_offset_coordinates = get_probe_atlas_tile(probe_index);
 
   vec4 current_offset = vec4(0);
   // Read previous offset after the first frame.
   if( first_frame == 0 ) {
-    const int probe_counts_xy                   = probe_counts.x * probe_counts.y;
-    ivec2     probe_offset_sampling_coordinates = ivec2(probe_index % probe_counts_xy, probe_index / probe_counts_xy);
-    current_offset.rgb = texelFetch(global_textures[nonuniformEXT(probe_offset_texture_index)], probe_offset_sampling_coordinates, 0).rgb;
+    current_offset.rgb = texelFetch(probe_textures[PROBE_OFFSETS_TEXTURE], probe_offset_coordinates, 0).rgb;
   }
 
   // Check if 1/4 of the rays hit a backface
   // If that's the case, we can assume the probe is inside a geometry.
-  const bool inside_geometry = (float(backfaces_count) / probe_rays) > 0.25f;
+  const bool inside_geometry = (float(backfaces_count) / ray_count) > 0.25f;
 
   if(inside_geometry && (closest_backface_index != -1)) {
     // Calculate the backface direction
     // Distance is always positive
-    const vec3 closest_backface_direction = closest_backface_distance * normalize(mat3(random_rotation) * spherical_fibonacci(closest_backface_index, probe_rays));
+    const vec3 closest_backface_direction = closest_backface_distance * get_probe_ray_direction(closest_backface_index, ray_count);
 
     // Find the maximum offset inside the cell.
     const vec3 positive_offset = (current_offset.xyz + cell_offset_limit) / closest_backface_direction;
@@ -105,8 +120,8 @@ void main() {
 
     // Ensure that we never move through the farthest frontface
     // Move minimum distance to ensure not moving on a future iteration.
-    const vec3 farthest_direction = min(0.2f, farthest_frontface_distance) * normalize(mat3(random_rotation) * spherical_fibonacci(farthest_frontface_index, probe_rays));
-    const vec3 closest_direction = normalize(mat3(random_rotation) * spherical_fibonacci(closest_frontface_index, probe_rays));
+    const vec3 farthest_direction = min(0.2f, farthest_frontface_distance) * get_probe_ray_direction(farthest_frontface_index, ray_count);
+    const vec3 closest_direction = get_probe_ray_direction(closest_frontface_index, ray_count);
     
     /* The farthest frontface may also be the closest if the probe can only
     see one surface. If this is the case, don't move the probe */
@@ -121,10 +136,5 @@ void main() {
   }
 
   // Write probe offset
-  const int probe_counts_xy = probe_counts.x * probe_counts.y;
-
-  const int probe_texel_x = (probe_index % probe_counts_xy);
-  const int probe_texel_y = probe_index / probe_counts_xy;
-
-  imageStore(global_images_2d[probe_offset_texture_index], ivec2(probe_texel_x, probe_texel_y), current_offset);
+  imageStore(probe_offsets_image, probe_offset_coordinates, current_offset);
 }
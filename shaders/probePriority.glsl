@@ -0,0 +1,78 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(push_constant) uniform _PushConstantSchedule {
+  PushConstantSchedule pcSchedule;
+};
+
+layout(set = 1, binding = eGlobals) uniform _GlobalUniforms {
+  GlobalUniforms uni;
+};
+
+
+layout(std430, set = 0, binding = eStatus) readonly buffer ProbeStatusSSBO {
+  uint probe_status[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+// Ranks every probe of the grid and counts them per priority bucket
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
+
+  int       probe_index  = coords.x;
+  const int total_probes = get_total_probe_count();
+  if(probe_index >= total_probes) {
+    return;
+  }
+
+  ProbeScheduleInfo info = probe_schedule[probe_index];
+  info.age               = min(info.age + 1, 0xFFFFu);
+
+  const int volume      = get_probe_volume(probe_index);
+  const int volume_rays = get_volume_rays(volume);
+
+  // Probes inside geometry, or never classified, cost nothing
+  const uint status     = probe_status[probe_index];
+  const bool skip_probe = (status == PROBE_STATUS_OFF) || (status == PROBE_STATUS_UNINITIALISED);
+  // Probes exposed by a scroll are traced until their offset is placed
+  const bool relocating = info.reset > 0;
+
+  if(pcSchedule.keep_all == 1 || relocating) {
+    info.bucket = PROBE_PRIORITY_BUCKETS - 1;
+  }
+  else if(use_probe_status() && skip_probe) {
+    info.bucket = PROBE_NOT_SCHEDULED;
+  }
+  else {
+    const vec3  probe_position = get_probe_world_position(probe_index);
+    const float cell_size      = length(get_volume_spacing(volume));
+    const float priority       = get_probe_priority(probe_position, cell_size, uni.viewProj, uni.position, info.age, info.irradiance_change);
+    info.bucket                = min(uint(priority * PROBE_PRIORITY_BUCKETS), uint(PROBE_PRIORITY_BUCKETS - 1));
+  }
+
+  // Fixed for the whole frame, the trace and the blends read it back. Every ray until there is something to go by.
+  if(pcSchedule.keep_all == 1 || relocating || info.has_statistics == 0) {
+    info.ray_count = uint(volume_rays);
+  }
+  else {
+    info.ray_count = get_probe_ray_count(info.luminance_mean, info.luminance_variance, info.irradiance_change, volume_rays);
+  }
+
+  if(info.bucket != PROBE_NOT_SCHEDULED) {
+    atomicAdd(priority_histogram[info.bucket], 1);
+  }
+  probe_schedule[probe_index] = info;
+}
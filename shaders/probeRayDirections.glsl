@@ -0,0 +1,17 @@
+#ifndef PROBE_RAY_DIRECTIONS
+#define PROBE_RAY_DIRECTIONS
+
+// Ray direction table
+//--------------------------------------------------------------------------------
+// Rotated directions of every ray count a probe can trace, written once per frame by the direction pass.
+// Count k * PROBE_RAY_GRANULARITY starts at PROBE_RAY_GRANULARITY * k * (k - 1) / 2, counts are laid out back to back.
+
+layout(std430, set = 0, binding = eRayDirections) readonly buffer RayDirectionsSSBO {
+  vec4 ray_directions[PROBE_RAY_TABLE_SIZE];
+};
+
+vec3 get_probe_ray_direction(int ray_index, int ray_count) {
+  return ray_directions[get_ray_table_offset(ray_count) + ray_index].xyz;
+}
+
+#endif
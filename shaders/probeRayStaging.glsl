@@ -0,0 +1,28 @@
+#include "probeRayDirections.glsl"
+
+// Ray row staging for the probe blends
+//--------------------------------------------------------------------------------
+// A blend workgroup owns one probe tile. The probe's radiance row and ray directions are loaded into shared memory once,
+// then every texel of the tile blends from there instead of fetching the whole row on its own.
+
+shared vec4 staged_radiance[PROBE_MAX_RAYS];   // Radiance and hit distance, negative on backfaces
+shared vec3 staged_direction[PROBE_MAX_RAYS];  // Rotated ray direction
+
+// Strided over the workgroup: thread local_index loads rays local_index, local_index + group_size, ...
+// Returns the luminance sum, squared sum and count of the front facing rays it loaded.
+// The staged rays can be read after a shared memory barrier.
+vec3 stage_probe_rays(int probe_index, int ray_count, uint local_index, uint group_size) {
+  vec3 luminance_sums = vec3(0);
+  for(int ray_index = int(local_index); ray_index < ray_count; ray_index += int(group_size)) {
+    const vec4 radiance_sample = texelFetch(global_textures[nonuniformEXT(radiance_output_index)], ivec2(ray_index, probe_index), 0);
+
+    staged_radiance[ray_index]  = radiance_sample;
+    staged_direction[ray_index] = get_probe_ray_direction(ray_index, ray_count);
+
+    if(radiance_sample.w >= 0.0f) {
+      const float luminance = get_luminance(radiance_sample.rgb);
+      luminance_sums += vec3(luminance, luminance * luminance, 1.0f);
+    }
+  }
+  return luminance_sums;
+}
@@ -0,0 +1,64 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(std430, set = 0, binding = eStatus) buffer ProbeStatusSSBO {
+  uint probe_status[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+// Hands the slots of the planes a volume left behind to the planes it exposed. Runs before the scheduling
+// on frames where a volume scrolled: the new probes are forced into the update list until their offset is
+// placed, and their first blend ignores the history of the slot. Every other probe keeps its atlas tiles, offset and status untouched.
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  const int probe_index = int(gl_GlobalInvocationID.x);
+  if(probe_index >= get_total_probe_count()) {
+    return;
+  }
+
+  const int   volume = get_probe_volume(probe_index);
+  const ivec3 delta  = probe_volumes[volume].scroll_delta.xyz;
+  const ivec3 counts = probe_volumes[volume].counts.xyz;
+  if(delta == ivec3(0)) {
+    return;
+  }
+
+  // Grid indices under the new scroll. A move of +d cells exposes the last d planes of an axis, -d the first d.
+  const ivec3 storage_indices = probe_index_to_storage_indices(probe_index, volume);
+  const ivec3 grid_indices    = storage_to_grid_indices(storage_indices, volume);
+
+  const bvec3 exposed_high = bvec3(delta.x > 0 && grid_indices.x >= counts.x - delta.x,
+                                   delta.y > 0 && grid_indices.y >= counts.y - delta.y,
+                                   delta.z > 0 && grid_indices.z >= counts.z - delta.z);
+  const bvec3 exposed_low  = bvec3(delta.x < 0 && grid_indices.x < -delta.x,
+                                   delta.y < 0 && grid_indices.y < -delta.y,
+                                   delta.z < 0 && grid_indices.z < -delta.z);
+  if(!any(exposed_high) && !any(exposed_low)) {
+    return;
+  }
+
+  ProbeScheduleInfo info  = probe_schedule[probe_index];
+  info.age                = uint(probe_age_horizon);
+  info.irradiance_change  = 0.0f;
+  info.has_statistics     = 0;
+  info.reset              = PROBE_RELOCATION_FRAMES;
+  probe_schedule[probe_index] = info;
+
+  // Classified again by the status pass once traced
+  probe_status[probe_index] = PROBE_STATUS_ACTIVE;
+
+  const ivec3 offset_coords = get_probe_atlas_tile(storage_indices, volume);
+  imageStore(probe_offsets_image, offset_coords, vec4(0));
+}
\ No newline at end of file
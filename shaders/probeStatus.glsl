@@ -5,6 +5,7 @@
 
 #include "host_device.h"
 #include "probeUtil.glsl"
+#include "probeRayDirections.glsl"
 
 
 layout(push_constant) uniform _PushConstantOffset {
@@ -16,6 +17,16 @@ layout(std430, set = 0, binding = eStatus) buffer ProbeStatusSSBO {
   uint probe_status[];
 };
 
+layout(std430, set = 0, binding = eActiveProbes) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) readonly buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
 
 layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
 
@@ -23,9 +34,12 @@ void main() {
   uint  first_frame = pcStatus.first_frame;
   ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
 
-  int offset = 0;
-
-  int probe_index = coords.x;
+  // Invoke this shader for each probe traced this frame
+  if(uint(coords.x) >= active_args.trace_height) {
+    return;
+  }
+  int probe_index = active_probes[coords.x];
+  int ray_count   = int(probe_schedule[probe_index].ray_count);
 
   int   closest_backface_index    = -1;
   float closest_backface_distance = 100000000.f;
@@ -40,9 +54,10 @@ void main() {
   uint flag            = first_frame == 1 ? PROBE_STATUS_UNINITIALISED : probe_status[probe_index];
 
   // Worst case, view and normal contribute in the same direction, so need 2x self-shadow bias.
-  vec3 outerBounds = normalize(probe_spacing) * (length(probe_spacing) + (2.0f * self_shadow_bias));
+  const vec3 spacing     = get_volume_spacing(get_probe_volume(probe_index));
+  vec3       outerBounds = normalize(spacing) * (length(spacing) + (2.0f * self_shadow_bias));
 
-  for(int ray_index = 0; ray_index < probe_rays; ++ray_index) {
+  for(int ray_index = 0; ray_index < ray_count; ++ray_index) {
     ivec2 ray_tex_coord = ivec2(ray_index, probe_index);
 
     // Distance is negative if we hit a backface
@@ -62,7 +77,7 @@ void main() {
 
     if(d_front > 0.0f) {
       // Check all frontfaces to see if any are wihtin shading range
-      vec3 frontFaceDirection = d_front * normalize(mat3(random_rotation) * spherical_fibonacci(ray_index, probe_rays));
+      vec3 frontFaceDirection = d_front * get_probe_ray_direction(ray_index, ray_count);
       if(all(lessThan(abs(frontFaceDirection), outerBounds))) {
         // There is a static surface being shaded by this probe. Make it "just vigilant"
         flag = PROBE_STATUS_ACTIVE;
@@ -79,7 +94,7 @@ void main() {
   }
 
   // If there's a close backface AND we more than 25% of hits are backfaces, assume we're inside some mesh
-  if(closest_backface_index != -1 && (float(backfaces_count) / probe_rays) > 0.25f) {
+  if(closest_backface_index != -1 && (float(backfaces_count) / ray_count) > 0.25f) {
     flag = PROBE_STATUS_OFF;
   }
   else if(closest_frontface_index == -1) {
@@ -0,0 +1,61 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+
+
+layout(std430, set = 0, binding = eActiveProbes) buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout(std430, set = 0, binding = eProbeSchedule) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+// Walks the histogram from the highest priority down until the update budget is filled,
+// then writes the indirect arguments of every probe pass. A single thread, the histogram is tiny.
+layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+void main() {
+  const uint budget = uint(probe_update_count);
+
+  uint selected  = 0;
+  uint threshold = PROBE_PRIORITY_BUCKETS - 1;
+  uint ties      = 0;
+  for(int bucket = PROBE_PRIORITY_BUCKETS - 1; bucket >= 0; --bucket) {
+    const uint count = priority_histogram[bucket];
+    threshold        = bucket;
+    if(selected + count >= budget) {
+      ties     = budget - selected;
+      selected = budget;
+      break;
+    }
+    ties = count;
+    selected += count;
+  }
+
+  // Cleared here for the next frame, the compaction pass only needs the threshold
+  for(int bucket = 0; bucket < PROBE_PRIORITY_BUCKETS; ++bucket) {
+    priority_histogram[bucket] = 0;
+  }
+
+  active_args.trace_width      = 0;  // Raised to the largest ray count by the compaction pass
+  active_args.trace_height     = selected;
+  active_args.trace_depth      = 1;
+  active_args.blend_x          = selected;
+  active_args.blend_y          = 1;
+  active_args.blend_z          = 1;
+  active_args.probe_x          = (selected + 31) / 32;
+  active_args.probe_y          = 1;
+  active_args.probe_z          = 1;
+  active_args.threshold_bucket = threshold;
+  active_args.tie_budget       = ties;
+  active_args.tie_count        = 0;
+  active_args.cursor           = 0;
+}
@@ -0,0 +1,185 @@
+#version 460
+
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+#include "probeRayStaging.glsl"
+
+// Irradiance and visibility blended in one pass: every ray of the probe row is staged once,
+// then accumulated into both the irradiance and the distance moments of the texel.
+// Both atlases share the probe layout, 6x6 texels plus the 1 texel border.
+
+layout(IRRADIANCE_IMAGE_FORMAT, set = 0, binding = eIrradianceImage) uniform image2DArray irradiance_image;
+layout(VISIBILITY_IMAGE_FORMAT, set = 0, binding = eVisibilityImage) uniform image2DArray visibility_image;
+
+layout( set = 0, binding = eActiveProbes ) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout( set = 0, binding = eProbeSchedule ) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+
+#define EPSILON 0.0001f
+
+// One workgroup per active probe: 6x6 texels plus the 1 texel border, which the border pass fills afterwards
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// Per texel change of this blend, summed into the probe priority of the next frame
+shared float texel_change[8 * 8];
+// Ray luminance sum, squared sum and count over a strided slice of the rays, reduced into the probe statistics
+shared vec3 ray_luminance[8 * 8];
+
+
+void main() {
+  int probe_side_length = irradiance_side_length;
+
+  const uint probe_with_border_side = probe_side_length + 2;
+  const uint probe_last_pixel       = probe_side_length + 1;
+
+  // Every thread of the workgroup has to reach the barrier below, so nothing returns before it
+  const int  slot          = int(gl_WorkGroupID.x);
+  const bool active_thread = gl_LocalInvocationID.x < probe_with_border_side && gl_LocalInvocationID.y < probe_with_border_side;
+
+  const int probe_index       = active_probes[slot];
+  ivec3     irradiance_coords = get_probe_atlas_top_left(probe_index, int(probe_with_border_side)) + ivec3(gl_LocalInvocationID.xy, 0);
+  ivec3     visibility_coords = get_probe_atlas_top_left(probe_index, int(probe_with_border_side)) + ivec3(gl_LocalInvocationID.xy, 0);
+
+  // Check if thread is a border pixel
+  const uint probe_pixel_x = gl_LocalInvocationID.x;
+  const uint probe_pixel_y = gl_LocalInvocationID.y;
+  bool border_pixel = (probe_pixel_x == 0) || (probe_pixel_x == probe_last_pixel);
+  border_pixel = border_pixel || (probe_pixel_y == 0) || (probe_pixel_y == probe_last_pixel);
+
+
+  const uint local_index   = gl_LocalInvocationIndex;
+  texel_change[local_index] = 0.0f;
+
+  const int ray_count = min(int(probe_schedule[probe_index].ray_count), PROBE_MAX_RAYS);
+  // A probe new to its slot starts from this blend instead of the history of the slot
+  const float probe_hysteresis = probe_schedule[probe_index].reset == PROBE_RELOCATION_FRAMES ? 0.0f : hysteresis;
+
+  ray_luminance[local_index] = stage_probe_rays(probe_index, ray_count, local_index, 8 * 8);
+  memoryBarrierShared();
+  barrier();
+
+  if(active_thread && !border_pixel) {
+    vec4        irradiance_result   = vec4(0);
+    vec4        visibility_result   = vec4(0);
+    const float energy_conservation = 0.95;
+
+    uint backfaces     = 0;
+    uint max_backfaces = uint(ray_count * 0.1f);
+    bool skip_texel    = false;
+
+    vec3 texel_direction = oct_decode(normalised_oct_coord(irradiance_coords.xy, probe_side_length));
+
+    for(int ray_index = 0; ray_index < ray_count; ++ray_index) {
+      vec3 ray_direction = staged_direction[ray_index];
+
+      float weight = max(0.0, dot(texel_direction, ray_direction));
+
+      vec4 radiance_sample = staged_radiance[ray_index];
+
+      if(radiance_sample.w < 0.0f && use_backfacing_blending()) {
+        ++backfaces;
+
+        // Early out: only blend ray radiance into the probe if the backface threshold hasn't been exceeded
+        if(backfaces >= max_backfaces) {
+          skip_texel = true;
+          break;
+        }
+        continue;
+      }
+
+      if(weight >= EPSILON) {
+        vec3 radiance = radiance_sample.rgb * energy_conservation;
+
+        // Storing the sum of the weights in alpha temporarily
+        irradiance_result += vec4(radiance * weight, weight);
+      }
+
+      float probe_max_ray_distance = 1.0f * 1.5f;
+
+      // Increase or decrease the filtered distance value's "sharpness"
+      float visibility_weight = pow(weight, 2.5f);
+
+      if(visibility_weight >= EPSILON) {
+        // Limit
+        float distance = min(abs(radiance_sample.w), probe_max_ray_distance);
+        vec3  value    = vec3(distance, distance * distance, 0);
+        // Storing the sum of the weights in alpha temporarily
+        visibility_result += vec4(value * visibility_weight, visibility_weight);
+      }
+    }
+
+    if(!skip_texel) {
+      if(irradiance_result.w > EPSILON) {
+        irradiance_result.xyz /= irradiance_result.w;
+        irradiance_result.w = 0.0f;
+      }
+      if(visibility_result.w > EPSILON) {
+        visibility_result.xyz /= visibility_result.w;
+        visibility_result.w = 1.0f;
+      }
+
+      // Read previous frame values
+      vec4 previous_irradiance = imageLoad(irradiance_image, irradiance_coords);
+      vec2 previous_visibility = imageLoad(visibility_image, visibility_coords).rg;
+
+      // Debug inside with color green
+      if(show_border_vs_inside()) {
+        irradiance_result = vec4(0, 1, 0, 1);
+        visibility_result = vec4(0, 1, 0, 1);
+      }
+
+      if(use_perceptual_encoding()) {
+        irradiance_result.rgb = pow(irradiance_result.rgb, vec3(1.0f / 5.0f));
+      }
+
+      irradiance_result = mix(irradiance_result, previous_irradiance, probe_hysteresis);
+      imageStore(irradiance_image, irradiance_coords, irradiance_result);
+
+      visibility_result.rg = mix(visibility_result.rg, previous_visibility, probe_hysteresis);
+      imageStore(visibility_image, visibility_coords, vec4(visibility_result.rg, 0, 1));
+
+      texel_change[local_index] = length(irradiance_result.rgb - previous_irradiance.rgb);
+    }
+  }
+
+  // Every texel has written its change before the reduction
+  memoryBarrierShared();
+  barrier();
+
+  if(local_index == 0) {
+    float change    = 0.0f;
+    vec3  luminance = vec3(0);
+    for(int i = 0; i < 8 * 8; ++i) {
+      change += texel_change[i];
+      luminance += ray_luminance[i];
+    }
+    probe_schedule[probe_index].irradiance_change = change / float(probe_side_length * probe_side_length);
+
+    // Running luminance statistics, they pick the ray count of the next update
+    if(luminance.z > 0.0f) {
+      const float mean     = luminance.x / luminance.z;
+      const float variance = max(luminance.y / luminance.z - mean * mean, 0.0f);
+      if(probe_schedule[probe_index].has_statistics == 0) {
+        probe_schedule[probe_index].luminance_mean     = mean;
+        probe_schedule[probe_index].luminance_variance = variance;
+        probe_schedule[probe_index].has_statistics     = 1;
+      }
+      else {
+        probe_schedule[probe_index].luminance_mean     = mix(mean, probe_schedule[probe_index].luminance_mean, hysteresis);
+        probe_schedule[probe_index].luminance_variance = mix(variance, probe_schedule[probe_index].luminance_variance, hysteresis);
+      }
+    }
+  }
+}
@@ -6,61 +6,87 @@
 
 #include "host_device.h"
 #include "probeUtil.glsl"
+#include "probeRayStaging.glsl"
 
-layout(rgba16f, set = 0, binding = eIrradianceImage) uniform image2D irradiance_image;
+layout(IRRADIANCE_IMAGE_FORMAT, set = 0, binding = eIrradianceImage) uniform image2DArray irradiance_image;
+
+layout( set = 0, binding = eActiveProbes ) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout( set = 0, binding = eProbeSchedule ) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
 
 
 
 #define EPSILON 0.0001f
-int k_read_table[6] = {5, 3, 1, -1, -3, -5};
 
+// One workgroup per active probe: 6x6 texels plus the 1 texel border, which the border pass fills afterwards
 layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
 
+// Per texel change of this blend, summed into the probe priority of the next frame
+shared float texel_change[8 * 8];
+// Ray luminance sum, squared sum and count over a strided slice of the rays, reduced into the probe statistics
+shared vec3 ray_luminance[8 * 8];
 
-void main() {
-  ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
 
-  int probe_texture_width  = irradiance_texture_width;
-  int probe_texture_height = irradiance_texture_height;
+void main() {
   int probe_side_length    = irradiance_side_length;
 
-  // Early out for 1 pixel border around all image and outside bound pixels.
-  if(coords.x >= probe_texture_width || coords.y >= probe_texture_height) {
-    return;
-  }
-
   const uint probe_with_border_side = probe_side_length + 2;
   const uint probe_last_pixel       = probe_side_length + 1;
 
-  int probe_index = get_probe_index_from_pixels(coords.xy, int(probe_with_border_side), probe_texture_width);
+  // Every thread of the workgroup has to reach the barrier below, so nothing returns before it
+  const int  slot          = int(gl_WorkGroupID.x);
+  const bool active_thread = gl_LocalInvocationID.x < probe_with_border_side && gl_LocalInvocationID.y < probe_with_border_side;
+
+  const int probe_index = active_probes[slot];
+  ivec3     coords      = get_probe_atlas_top_left(probe_index, int(probe_with_border_side)) + ivec3(gl_LocalInvocationID.xy, 0);
 
   // Check if thread is a border pixel
-  bool border_pixel = ((gl_GlobalInvocationID.x % probe_with_border_side) == 0) || ((gl_GlobalInvocationID.x % probe_with_border_side) == probe_last_pixel);
-  border_pixel = border_pixel || ((gl_GlobalInvocationID.y % probe_with_border_side) == 0) || ((gl_GlobalInvocationID.y % probe_with_border_side) == probe_last_pixel);
+  const uint probe_pixel_x = gl_LocalInvocationID.x;
+  const uint probe_pixel_y = gl_LocalInvocationID.y;
+  bool border_pixel = (probe_pixel_x == 0) || (probe_pixel_x == probe_last_pixel);
+  border_pixel = border_pixel || (probe_pixel_y == 0) || (probe_pixel_y == probe_last_pixel);
+
+
+  const uint local_index   = gl_LocalInvocationIndex;
+  texel_change[local_index] = 0.0f;
 
+  const int ray_count = min(int(probe_schedule[probe_index].ray_count), PROBE_MAX_RAYS);
+  // A probe new to its slot starts from this blend instead of the history of the slot
+  const float probe_hysteresis = probe_schedule[probe_index].reset == PROBE_RELOCATION_FRAMES ? 0.0f : hysteresis;
 
-  if(!border_pixel) {
+  ray_luminance[local_index] = stage_probe_rays(probe_index, ray_count, local_index, 8 * 8);
+  memoryBarrierShared();
+  barrier();
+
+  if(active_thread && !border_pixel) {
     vec4        result              = vec4(0);
     const float energy_conservation = 0.95;
 
     uint backfaces     = 0;
-    uint max_backfaces = uint(probe_rays * 0.1f);
+    uint max_backfaces = uint(ray_count * 0.1f);
+    bool skip_texel    = false;
 
-    for(int ray_index = 0; ray_index < probe_rays; ++ray_index) {
-      ivec2 sample_position = ivec2(ray_index, probe_index);
+    vec3 texel_direction = oct_decode(normalised_oct_coord(coords.xy, probe_side_length));
 
-      vec3 ray_direction   = normalize(mat3(random_rotation) * spherical_fibonacci(ray_index, probe_rays));
-      vec3 texel_direction = oct_decode(
-          (coords.xy, probe_side_length));
+    for(int ray_index = 0; ray_index < ray_count; ++ray_index) {
+      vec3 ray_direction   = staged_direction[ray_index];
 
       float weight = max(0.0, dot(texel_direction, ray_direction));
 
-      vec4 radiance_sample = texelFetch(global_textures[nonuniformEXT(radiance_output_index)], sample_position, 0);
+      vec4 radiance_sample = staged_radiance[ray_index];
 
       if(radiance_sample.w < 0.0f && use_backfacing_blending()) {
         ++backfaces;
-        if(backfaces >= max_backfaces)
-          return;
+        if(backfaces >= max_backfaces) {
+          skip_texel = true;
+          break;
+        }
         continue;
       }
 
@@ -72,78 +98,57 @@ void main() {
       }
     }
 
-    if(result.w > EPSILON) {
-      result.xyz /= result.w;
-      result.w = 0.0f;
-    }
+    if(!skip_texel) {
+      if(result.w > EPSILON) {
+        result.xyz /= result.w;
+        result.w = 0.0f;
+      }
 
-    // Read previous frame value
-    vec4 previous_value = imageLoad(irradiance_image, coords.xy);
+      // Read previous frame value
+      vec4 previous_value = imageLoad(irradiance_image, coords);
 
-    // Debug inside with color green
-    if(show_border_vs_inside()) {
-      result = vec4(0, 1, 0, 1);
-    }
+      // Debug inside with color green
+      if(show_border_vs_inside()) {
+        result = vec4(0, 1, 0, 1);
+      }
 
-    if(use_perceptual_encoding()) {
-      result.rgb = pow(result.rgb, vec3(1.0f / 5.0f));
-    }
+      if(use_perceptual_encoding()) {
+        result.rgb = pow(result.rgb, vec3(1.0f / 5.0f));
+      }
 
-    result = mix(result, previous_value, hysteresis);
-    imageStore(irradiance_image, coords.xy, result);
+      result = mix(result, previous_value, probe_hysteresis);
+      imageStore(irradiance_image, coords, result);
 
-    return;
+      texel_change[local_index] = length(result.rgb - previous_value.rgb);
+    }
   }
 
-  // Wait for all local threads to have finished to copy the border pixels.
-  groupMemoryBarrier();
+  // Every texel has written its change before the reduction
+  memoryBarrierShared();
   barrier();
 
-  // Operate with Border pixels
-  // Copy border pixel calculating source pixels.
-  const uint probe_pixel_x = gl_GlobalInvocationID.x % probe_with_border_side;
-  const uint probe_pixel_y = gl_GlobalInvocationID.y % probe_with_border_side;
-  bool       corner_pixel  = (probe_pixel_x == 0 || probe_pixel_x == probe_last_pixel) && (probe_pixel_y == 0 || probe_pixel_y == probe_last_pixel);
-  bool       row_pixel = (probe_pixel_x > 0 && probe_pixel_x < probe_last_pixel);
-
-  ivec2 source_pixel_coordinate = coords.xy;
-
-  if(corner_pixel) {
-    source_pixel_coordinate.x += probe_pixel_x == 0 ? probe_side_length : -probe_side_length;
-    source_pixel_coordinate.y += probe_pixel_y == 0 ? probe_side_length : -probe_side_length;
-
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(2, 2);
+  if(local_index == 0) {
+    float change    = 0.0f;
+    vec3  luminance = vec3(0);
+    for(int i = 0; i < 8 * 8; ++i) {
+      change += texel_change[i];
+      luminance += ray_luminance[i];
     }
-  }
-  else if(row_pixel) {
-    source_pixel_coordinate.x += k_read_table[probe_pixel_x - 1];
-    source_pixel_coordinate.y += (probe_pixel_y > 0) ? -1 : 1;
-
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(3, 3);
-    }
-  }
-  else {
-    source_pixel_coordinate.x += (probe_pixel_x > 0) ? -1 : 1;
-    source_pixel_coordinate.y += k_read_table[probe_pixel_y - 1];
-
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(4, 4);
+    probe_schedule[probe_index].irradiance_change = change / float(probe_side_length * probe_side_length);
+
+    // Running luminance statistics, they pick the ray count of the next update
+    if(luminance.z > 0.0f) {
+      const float mean     = luminance.x / luminance.z;
+      const float variance = max(luminance.y / luminance.z - mean * mean, 0.0f);
+      if(probe_schedule[probe_index].has_statistics == 0) {
+        probe_schedule[probe_index].luminance_mean     = mean;
+        probe_schedule[probe_index].luminance_variance = variance;
+        probe_schedule[probe_index].has_statistics     = 1;
+      }
+      else {
+        probe_schedule[probe_index].luminance_mean     = mix(mean, probe_schedule[probe_index].luminance_mean, hysteresis);
+        probe_schedule[probe_index].luminance_variance = mix(variance, probe_schedule[probe_index].luminance_variance, hysteresis);
+      }
     }
   }
-
-  vec4 copied_data = imageLoad(irradiance_image, source_pixel_coordinate);
-
-  // Debug border source coordinates
-  if(show_border_source_coordinates()) {
-    copied_data = vec4(coords.xy, source_pixel_coordinate);
-  }
-
-  // Debug border with color red
-  if(show_border_vs_inside()) {
-    copied_data = vec4(1, 0, 0, 1);
-  }
-
-  imageStore(irradiance_image, coords.xy, copied_data);
 }
\ No newline at end of file
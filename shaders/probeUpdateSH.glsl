@@ -0,0 +1,131 @@
+#version 460
+
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+#include "probeRayDirections.glsl"
+
+layout( set = 0, binding = eActiveProbes ) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout( set = 0, binding = eProbeSchedule ) buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
+};
+
+
+
+#define GROUP_SIZE 64
+
+// One workgroup per active probe, projecting its rays onto the L1 SH basis instead of blending an octahedral tile.
+// Every ray is read once, so the rays are not staged in shared memory.
+layout(local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// Per thread projection of a strided slice of the rays, coefficient i of thread t at i * GROUP_SIZE + t
+shared vec3  sh_partial[PROBE_SH_COEFFICIENTS * GROUP_SIZE];
+// Front facing and backfacing rays of the slice
+shared uvec2 ray_counts[GROUP_SIZE];
+// Ray luminance sum, squared sum and count, reduced into the probe statistics
+shared vec3  ray_luminance[GROUP_SIZE];
+
+
+void main() {
+  const int  probe_index = active_probes[gl_WorkGroupID.x];
+  const uint local_index = gl_LocalInvocationIndex;
+
+  const int ray_count = min(int(probe_schedule[probe_index].ray_count), PROBE_MAX_RAYS);
+  // A probe new to its slot starts from this blend instead of the history of the slot
+  const float probe_hysteresis = probe_schedule[probe_index].reset == PROBE_RELOCATION_FRAMES ? 0.0f : hysteresis;
+
+  vec3  sh[PROBE_SH_COEFFICIENTS] = vec3[](vec3(0), vec3(0), vec3(0), vec3(0));
+  uvec2 counts                    = uvec2(0);
+  vec3  luminance_sums            = vec3(0);
+
+  for(int ray_index = int(local_index); ray_index < ray_count; ray_index += GROUP_SIZE) {
+    const vec4 radiance_sample = texelFetch(global_textures[nonuniformEXT(radiance_output_index)], ivec2(ray_index, probe_index), 0);
+
+    if(radiance_sample.w >= 0.0f) {
+      const float luminance = get_luminance(radiance_sample.rgb);
+      luminance_sums += vec3(luminance, luminance * luminance, 1.0f);
+    }
+    else if(use_backfacing_blending()) {
+      ++counts.y;
+      continue;
+    }
+
+    const vec4 basis = get_sh_basis(get_probe_ray_direction(ray_index, ray_count));
+    for(int i = 0; i < PROBE_SH_COEFFICIENTS; ++i) {
+      sh[i] += radiance_sample.rgb * basis[i];
+    }
+    ++counts.x;
+  }
+
+  for(int i = 0; i < PROBE_SH_COEFFICIENTS; ++i) {
+    sh_partial[i * GROUP_SIZE + local_index] = sh[i];
+  }
+  ray_counts[local_index]    = counts;
+  ray_luminance[local_index] = luminance_sums;
+  memoryBarrierShared();
+  barrier();
+
+  // Thread i reduces and stores coefficient i
+  if(local_index >= PROBE_SH_COEFFICIENTS) {
+    return;
+  }
+
+  vec3  coefficient = vec3(0);
+  uvec2 total       = uvec2(0);
+  for(int i = 0; i < GROUP_SIZE; ++i) {
+    coefficient += sh_partial[local_index * GROUP_SIZE + i];
+    total += ray_counts[i];
+  }
+
+  // Same rule as the atlas blend: a probe seeing too many backfaces is inside geometry and keeps its old value
+  const uint max_backfaces = uint(ray_count * 0.1f);
+  const bool skip_probe    = (use_backfacing_blending() && total.y >= max_backfaces) || total.x == 0;
+
+  const ivec2 coords         = ivec2(local_index, probe_index);
+  const vec4  previous_value = imageLoad(global_images_2d[nonuniformEXT(probe_sh_index)], coords);
+  vec4        result         = previous_value;
+
+  if(!skip_probe) {
+    // Monte Carlo projection over the sphere, then the cosine lobe convolution divided by PI:
+    // 1 for the constant band, 2/3 for the linear band
+    const float energy_conservation = 0.95;
+    const float band_factor         = local_index == 0 ? 1.0f : 2.0f / 3.0f;
+    coefficient *= (4.0f * PI / float(total.x)) * band_factor * energy_conservation;
+
+    result = mix(vec4(coefficient, 0.0f), previous_value, probe_hysteresis);
+    imageStore(global_images_2d[nonuniformEXT(probe_sh_index)], coords, result);
+  }
+
+  if(local_index == 0) {
+    // Change of the mean irradiance, the constant band alone
+    probe_schedule[probe_index].irradiance_change = length(result.rgb - previous_value.rgb) * 0.282095f;
+
+    vec3 luminance = vec3(0);
+    for(int i = 0; i < GROUP_SIZE; ++i) {
+      luminance += ray_luminance[i];
+    }
+
+    // Running luminance statistics, they pick the ray count of the next update
+    if(luminance.z > 0.0f) {
+      const float mean     = luminance.x / luminance.z;
+      const float variance = max(luminance.y / luminance.z - mean * mean, 0.0f);
+      if(probe_schedule[probe_index].has_statistics == 0) {
+        probe_schedule[probe_index].luminance_mean     = mean;
+        probe_schedule[probe_index].luminance_variance = variance;
+        probe_schedule[probe_index].has_statistics     = 1;
+      }
+      else {
+        probe_schedule[probe_index].luminance_mean     = mix(mean, probe_schedule[probe_index].luminance_mean, hysteresis);
+        probe_schedule[probe_index].luminance_variance = mix(variance, probe_schedule[probe_index].luminance_variance, hysteresis);
+      }
+    }
+  }
+}
\ No newline at end of file
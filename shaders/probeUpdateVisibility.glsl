@@ -6,66 +6,79 @@
 
 #include "host_device.h"
 #include "probeUtil.glsl"
+#include "probeRayStaging.glsl"
 
-layout(rg16f, set = 0, binding = eVisibilityImage) uniform image2D visibility_image;
+layout(VISIBILITY_IMAGE_FORMAT, set = 0, binding = eVisibilityImage) uniform image2DArray visibility_image;
 
-layout( set = 0, binding = eStatus ) readonly buffer ProbeStatusSSBO {
-  uint probe_status[];
+layout( set = 0, binding = eActiveProbes ) readonly buffer ActiveProbesSSBO {
+  ProbeIndirectArgs active_args;
+  int               active_probes[];
+};
+
+layout( set = 0, binding = eProbeSchedule ) readonly buffer ProbeScheduleSSBO {
+  uint              priority_histogram[PROBE_PRIORITY_BUCKETS];
+  ProbeScheduleInfo probe_schedule[];
 };
 
 
 #define EPSILON 0.0001f
-int k_read_table[6] = {5, 3, 1, -1, -3, -5};
 
+// One workgroup per active probe: 6x6 texels plus the 1 texel border, which the border pass fills afterwards
 layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
 
 
 void main(){
-  ivec3 coords = ivec3(gl_GlobalInvocationID.xyz);
-
-  int probe_texture_width  = visibility_texture_width;
-  int probe_texture_height = visibility_texture_height;
   int probe_side_length    = visibility_side_length;
 
-
-  // Early out for 1 pixel border around all image and outside bound pixels.
-  if(coords.x >= probe_texture_width || coords.y >= probe_texture_height) {
-    return;
-  }
-
   const uint probe_with_border_side = probe_side_length + 2;
   const uint probe_last_pixel       = probe_side_length + 1;
 
-  int probe_index = get_probe_index_from_pixels(coords.xy, int(probe_with_border_side), probe_texture_width);
+  // Every thread of the workgroup has to reach the barrier below, so nothing returns before it
+  const int  slot          = int(gl_WorkGroupID.x);
+  const bool active_thread = gl_LocalInvocationID.x < probe_with_border_side && gl_LocalInvocationID.y < probe_with_border_side;
+
+  const int probe_index = active_probes[slot];
+  ivec3     coords      = get_probe_atlas_top_left(probe_index, int(probe_with_border_side)) + ivec3(gl_LocalInvocationID.xy, 0);
 
   // Check if thread is a border pixel
-  bool border_pixel = ((gl_GlobalInvocationID.x % probe_with_border_side) == 0) || ((gl_GlobalInvocationID.x % probe_with_border_side) == probe_last_pixel);
-  border_pixel = border_pixel || ((gl_GlobalInvocationID.y % probe_with_border_side) == 0) || ((gl_GlobalInvocationID.y % probe_with_border_side) == probe_last_pixel);
+  const uint probe_pixel_x = gl_LocalInvocationID.x;
+  const uint probe_pixel_y = gl_LocalInvocationID.y;
+  bool border_pixel = (probe_pixel_x == 0) || (probe_pixel_x == probe_last_pixel);
+  border_pixel = border_pixel || (probe_pixel_y == 0) || (probe_pixel_y == probe_last_pixel);
+
+  const int ray_count = min(int(probe_schedule[probe_index].ray_count), PROBE_MAX_RAYS);
+  // A probe new to its slot starts from this blend instead of the history of the slot
+  const float probe_hysteresis = probe_schedule[probe_index].reset == PROBE_RELOCATION_FRAMES ? 0.0f : hysteresis;
+
+  stage_probe_rays(probe_index, ray_count, gl_LocalInvocationIndex, 8 * 8);
+  memoryBarrierShared();
+  barrier();
 
-  if(!border_pixel) {
+  if(active_thread && !border_pixel) {
     vec4 result = vec4(0);
 
     const float energy_conservation = 0.95;
 
     uint backfaces     = 0;
-    uint max_backfaces = uint(probe_rays * 0.1f);
-
-    for(int ray_index = 0; ray_index < probe_rays; ++ray_index) {
-      ivec2 sample_position = ivec2(ray_index, probe_index);
+    uint max_backfaces = uint(ray_count * 0.1f);
+    bool skip_texel    = false;
 
-      vec3 ray_direction = normalize(mat3(random_rotation) * spherical_fibonacci(ray_index, probe_rays));
+    vec3 texel_direction = oct_decode(normalised_oct_coord(coords.xy, probe_side_length));
 
-      vec3 texel_direction = oct_decode(normalised_oct_coord(coords.xy, probe_side_length));
+    for(int ray_index = 0; ray_index < ray_count; ++ray_index) {
+      vec3 ray_direction = staged_direction[ray_index];
 
       float weight = max(0.0, dot(texel_direction, ray_direction));
 
-      float distance2 = texelFetch(global_textures[nonuniformEXT(radiance_output_index)], sample_position, 0).w;
+      float distance2 = staged_radiance[ray_index].w;
       if(distance2 < 0.0f && use_backfacing_blending()) {
         ++backfaces;
 
         // Early out: only blend ray radiance into the probe if the backface threshold hasn't been exceeded
-        if(backfaces >= max_backfaces)
-          return;
+        if(backfaces >= max_backfaces) {
+          skip_texel = true;
+          break;
+        }
 
         continue;
       }
@@ -77,7 +90,7 @@ void main(){
       weight = pow(weight, 2.5f);
 
       if(weight >= EPSILON) {
-        float distance = texelFetch(global_textures[nonuniformEXT(radiance_output_index)], sample_position, 0).w;
+        float distance = distance2;
         // Limit
         distance   = min(abs(distance), probe_max_ray_distance);
         vec3 value = vec3(distance, distance * distance, 0);
@@ -86,75 +99,23 @@ void main(){
       }
     }
 
-    if(result.w > EPSILON) {
-      result.xyz /= result.w;
-      result.w = 1.0f;
-    }
-
-    // Read previous frame value
-    vec2 previous_value = imageLoad(visibility_image, coords.xy).rg;
-
-    // Debug inside with color green
-    if(show_border_vs_inside()) {
-      result = vec4(0, 1, 0, 1);
-    }
-
-    result.rg           = mix(result.rg, previous_value, hysteresis);
-    imageStore(visibility_image, coords.xy, vec4(result.rg, 0, 1));
-
-
-    return;
-  }
-
-  // Wait for all local threads to have finished to copy the border pixels.
-  groupMemoryBarrier();
-  barrier();
-
-  // Copy border pixel calculating source pixels.
-  const uint probe_pixel_x = gl_GlobalInvocationID.x % probe_with_border_side;
-  const uint probe_pixel_y = gl_GlobalInvocationID.y % probe_with_border_side;
-  bool       corner_pixel  = (probe_pixel_x == 0 || probe_pixel_x == probe_last_pixel)
-                      && (probe_pixel_y == 0 || probe_pixel_y == probe_last_pixel);
-  bool row_pixel = (probe_pixel_x > 0 && probe_pixel_x < probe_last_pixel);
-
-  ivec2 source_pixel_coordinate = coords.xy;
-
-  if(corner_pixel) {
-    source_pixel_coordinate.x += probe_pixel_x == 0 ? probe_side_length : -probe_side_length;
-    source_pixel_coordinate.y += probe_pixel_y == 0 ? probe_side_length : -probe_side_length;
+    if(!skip_texel) {
+      if(result.w > EPSILON) {
+        result.xyz /= result.w;
+        result.w = 1.0f;
+      }
 
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(2, 2);
-    }
-  }
-  else if(row_pixel) {
-    source_pixel_coordinate.x += k_read_table[probe_pixel_x - 1];
-    source_pixel_coordinate.y += (probe_pixel_y > 0) ? -1 : 1;
+      // Read previous frame value
+      vec2 previous_value = imageLoad(visibility_image, coords).rg;
 
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(3, 3);
-    }
-  }
-  else {
-    source_pixel_coordinate.x += (probe_pixel_x > 0) ? -1 : 1;
-    source_pixel_coordinate.y += k_read_table[probe_pixel_y - 1];
+      // Debug inside with color green
+      if(show_border_vs_inside()) {
+        result = vec4(0, 1, 0, 1);
+      }
 
-    if(show_border_type()) {
-      source_pixel_coordinate = ivec2(4, 4);
+      result.rg           = mix(result.rg, previous_value, probe_hysteresis);
+      imageStore(visibility_image, coords, vec4(result.rg, 0, 1));
     }
   }
 
-  vec4 copied_data = imageLoad(visibility_image, source_pixel_coordinate);
-
-  // Debug border source coordinates
-  if(show_border_source_coordinates()) {
-    copied_data = vec4(coords.xy, source_pixel_coordinate);
-  }
-
-  // Debug border with color red
-  if(show_border_vs_inside()) {
-    copied_data = vec4(1, 0, 0, 1);
-  }
-
-  imageStore(visibility_image, coords.xy, copied_data);
 }
\ No newline at end of file
@@ -9,9 +9,38 @@
 #define PROBE_STATUS_ACTIVE 4
 #define PROBE_STATUS_UNINITIALISED 6
 
-layout(set = 0, binding = eStorageImages, rgba8) uniform image2D global_images_2d[];
+// Storage formats
+// Radiance, offsets and indirect all are RGBA16F. The atlases are RGBA16F, or with COMPACT_ATLASES
+// R11G11B10 irradiance (alpha is never sampled) and RG16 visibility (only the distance moments).
+// The host builds the probe pipelines from the variant matching the formats it created.
+#define GLOBAL_IMAGE_FORMAT rgba16f
+#ifdef COMPACT_ATLASES
+#define IRRADIANCE_IMAGE_FORMAT r11f_g11f_b10f
+#define VISIBILITY_IMAGE_FORMAT rg16f
+#else
+#define IRRADIANCE_IMAGE_FORMAT rgba16f
+#define VISIBILITY_IMAGE_FORMAT rgba16f
+#endif
+
+layout(set = 0, binding = eStorageImages, GLOBAL_IMAGE_FORMAT) uniform image2D global_images_2d[];
 layout(set = 0, binding = eGlobalTextures) uniform sampler2D global_textures[];
 
+// Array views of the offsets texture and both atlases, a layer per z slice of every volume
+layout(set = 0, binding = eOffsetsImage, GLOBAL_IMAGE_FORMAT) uniform image2DArray probe_offsets_image;
+layout(set = 0, binding = eProbeTextures) uniform sampler2DArray probe_textures[3];
+#define PROBE_OFFSETS_TEXTURE 0
+#define PROBE_IRRADIANCE_TEXTURE 1
+#define PROBE_VISIBILITY_TEXTURE 2
+
+// One probe grid, see Probe_Grid on the host
+struct ProbeVolume {
+  vec4  origin;        // World position of grid index 0
+  vec4  spacing;       // Probe spacing, size of the debug spheres relative to the main grid in w
+  ivec4 counts;        // Probe counts, index of the first probe in w
+  ivec4 scroll;        // Storage slot of grid index 0, first atlas layer in w
+  ivec4 scroll_delta;  // Cells scrolled this frame, most rays of a probe in w
+};
+
 layout(set = 0, binding = eConstants) uniform DDGIConstants {
     // Indices
     uint radiance_output_index;
@@ -26,7 +55,7 @@ layout(set = 0, binding = eConstants) uniform DDGIConstants {
 
     float hysteresis;
     float infinite_bounces_multiplier;
-    int   probe_update_offset;
+    int   probe_age_horizon;
     int   probe_update_count;
 
     vec3  probe_grid_position;
@@ -49,10 +78,23 @@ layout(set = 0, binding = eConstants) uniform DDGIConstants {
     int visibility_texture_width;
     int visibility_texture_height;
     int visibility_side_length;
-    int pad003_ddgic;
+    int probe_min_rays;
 
     mat4 random_rotation;
     vec2 resolution;
+    uint probe_sh_index;
+    int  probe_volume_count;
+
+    ProbeVolume probe_volumes[PROBE_MAX_VOLUMES];
+
+    uint indirect_low_res_index;
+
+    uint  motion_texture_index;
+    uint  indirect_history_index;
+    uint  indirect_history_output_index;
+    uint  indirect_guide_index;
+    uint  indirect_guide_output_index;
+    float temporal_max_history;
 };
 
 
@@ -96,6 +138,14 @@ bool use_infinite_bounces() {
   return (ddgi_debug_options & 512) == 512;
 }
 
+bool use_sh_irradiance() {
+  return (ddgi_debug_options & 1024) == 1024;
+}
+
+bool use_surface_cache() {
+  return (ddgi_debug_options & 2048) == 2048;
+}
+
 
 const float PI  = 3.14159265358979323846;
 const float PHI = (sqrt(5.0) * 0.5) + 0.5;
@@ -163,15 +213,12 @@ vec2 normalised_oct_coord(ivec2 fragCoord, int probe_side_length) {
 }
 
 
-vec2 get_probe_uv(vec3 direction, int probe_index, int full_texture_width, int full_texture_height, int probe_side_length) {
+// Layer uv of a direction in an atlas tile, the tile layer in z
+vec3 get_probe_uv(vec3 direction, ivec3 probe_indices, int full_texture_width, int full_texture_height, int probe_side_length) {
   // Get octahedral coordinates (-1,1)
   const vec2 octahedral_coordinates = oct_encode(normalize(direction));
 
   const float probe_with_border_side = float(probe_side_length) + 2.0f;
-  const int   probes_per_row         = (full_texture_width) / int(probe_with_border_side);
-  
-  // Get probe indices in the atlas
-  ivec2 probe_indices = ivec2((probe_index % probes_per_row), (probe_index / probes_per_row));
 
   // Get top left atlas texels
   vec2 atlas_texels = vec2(probe_indices.x * probe_with_border_side, probe_indices.y * probe_with_border_side);
@@ -184,10 +231,9 @@ vec2 get_probe_uv(vec3 direction, int probe_index, int full_texture_width, int f
   // Calculate final uvs
   const vec2 uv = atlas_texels / vec2(float(full_texture_width), float(full_texture_height));
   
-  return uv;
+  return vec3(uv, probe_indices.z);
 }
 
-
 vec2 texture_coord_from_direction(vec3 dir, int probe_index, int full_texture_width, int full_texture_height, int probe_side_length) {
   // Get encoded [-1,1] octahedral coordinate
   vec2 normalised_oct_coord = oct_encode(normalize(dir));
@@ -214,180 +260,405 @@ vec2 texture_coord_from_direction(vec3 dir, int probe_index, int full_texture_wi
 
 // Probe coordinate system
 //--------------------------------------------------------------------------------
+// probe_volume_count volumes, each a grid of its own counts and spacing: the extra volumes placed by hand, then the
+// cascades of the main grid. Every per probe resource holds the volumes one after the other, a volume's probe indices
+// start at counts.w. The storage indices of a probe are its slot inside its volume.
+// A volume scrolls toroidally: grid index g lives in slot (g + scroll) mod counts, so moving the volume by whole cells
+// only hands the slots of the planes it leaves to the planes it exposes.
+
+int get_volume_probe_count(int volume) {
+  const ivec3 counts = probe_volumes[volume].counts.xyz;
+  return counts.x * counts.y * counts.z;
+}
+
+int get_total_probe_count() {
+  return probe_volumes[probe_volume_count - 1].counts.w + get_volume_probe_count(probe_volume_count - 1);
+}
+
+int get_probe_volume(int probe_index) {
+  int volume = 0;
+  for(int v = 1; v < probe_volume_count; ++v) {
+    volume = probe_index >= probe_volumes[v].counts.w ? v : volume;
+  }
+  return volume;
+}
+
+vec3 get_volume_spacing(int volume) {
+  return probe_volumes[volume].spacing.xyz;
+}
+
+int get_volume_rays(int volume) {
+  return probe_volumes[volume].scroll_delta.w;
+}
+
+// Storage indices of a probe
+ivec3 probe_index_to_storage_indices(int probe_index, int volume) {
+  const ivec3 counts      = probe_volumes[volume].counts.xyz;
+  const int   local_index = probe_index - probe_volumes[volume].counts.w;
+  const int   counts_xy   = counts.x * counts.y;
+
+  return ivec3(local_index % counts.x, (local_index % counts_xy) / counts.x, local_index / counts_xy);
+}
+
+
+int probe_indices_to_index(in ivec3 storage_indices, int volume) {
+  const ivec4 counts = probe_volumes[volume].counts;
+  return counts.w + storage_indices.x + storage_indices.y * counts.x + storage_indices.z * counts.x * counts.y;
+}
 
-ivec3 probe_index_to_grid_indices(int probe_index) {
-  const int probe_x         = probe_index % probe_counts.x;
-  const int probe_counts_xy = probe_counts.x * probe_counts.y;
+// Grid indices of a volume to storage indices and back
+ivec3 grid_to_storage_indices(ivec3 grid_indices, int volume) {
+  return (grid_indices + probe_volumes[volume].scroll.xyz) % probe_volumes[volume].counts.xyz;
+}
 
-  const int probe_y = (probe_index % probe_counts_xy) / probe_counts.x;
-  const int probe_z = probe_index / probe_counts_xy;
+ivec3 storage_to_grid_indices(ivec3 storage_indices, int volume) {
+  const ivec3 counts = probe_volumes[volume].counts.xyz;
+  return (storage_indices - probe_volumes[volume].scroll.xyz + counts) % counts;
+}
 
-  return ivec3(probe_x, probe_y, probe_z);
+vec3 grid_indices_to_world_no_offsets(ivec3 grid_indices, int volume) {
+  return grid_indices * get_volume_spacing(volume) + probe_volumes[volume].origin.xyz;
 }
 
 
-int probe_indices_to_index(in ivec3 probe_coords) {
-  return int(probe_coords.x + probe_coords.y * probe_counts.x + probe_coords.z * probe_counts.x * probe_counts.y);
+// Atlas layout
+// Both atlases are 2D arrays with a layer per z slice of every volume, each volume from its first layer on. A layer is
+// as wide and as tall in tiles as the largest volume. The offsets texture has one texel per tile, in the same layers.
+// Tile in xy, layer in z.
+ivec3 get_probe_atlas_tile(ivec3 storage_indices, int volume) {
+  return ivec3(storage_indices.xy, probe_volumes[volume].scroll.w + storage_indices.z);
+}
+
+ivec3 get_probe_atlas_tile(int probe_index) {
+  const int volume = get_probe_volume(probe_index);
+  return get_probe_atlas_tile(probe_index_to_storage_indices(probe_index, volume), volume);
+}
+
+// Top left texel of a probe in its atlas layer, border included, the layer in z
+ivec3 get_probe_atlas_top_left(int probe_index, int probe_with_border_side) {
+  const ivec3 tile = get_probe_atlas_tile(probe_index);
+  return ivec3(tile.xy * probe_with_border_side, tile.z);
 }
 
-vec3 grid_indices_to_world_no_offsets(ivec3 grid_indices) {
-  return grid_indices * probe_spacing + probe_grid_position;
+vec3 get_probe_uv(vec3 direction, int probe_index, int full_texture_width, int full_texture_height, int probe_side_length) {
+  return get_probe_uv(direction, get_probe_atlas_tile(probe_index), full_texture_width, full_texture_height, probe_side_length);
 }
 
 
 
-vec3 grid_indices_to_world(ivec3 grid_indices, int probe_index) {
-  const int probe_counts_xy                   = probe_counts.x * probe_counts.y;
-  ivec2     probe_offset_sampling_coordinates = ivec2(probe_index % probe_counts_xy, probe_index / probe_counts_xy);
+vec3 grid_indices_to_world(ivec3 grid_indices, int volume) {
+  const ivec3 storage_indices                   = grid_to_storage_indices(grid_indices, volume);
+  ivec3       probe_offset_sampling_coordinates = get_probe_atlas_tile(storage_indices, volume);
   
-  vec3 probe_offset = use_probe_offsetting() ? texelFetch(global_textures[ nonuniformEXT( probe_offset_texture_index )], probe_offset_sampling_coordinates, 0).rgb : vec3(0);
+  vec3 probe_offset = use_probe_offsetting() ? texelFetch(probe_textures[PROBE_OFFSETS_TEXTURE], probe_offset_sampling_coordinates, 0).rgb : vec3(0);
 
-  return grid_indices_to_world_no_offsets(grid_indices) + probe_offset; 
+  return grid_indices_to_world_no_offsets(grid_indices, volume) + probe_offset; 
 }
 
+vec3 get_probe_world_position(int probe_index) {
+  const int volume = get_probe_volume(probe_index);
+  return grid_indices_to_world(storage_to_grid_indices(probe_index_to_storage_indices(probe_index, volume), volume), volume);
+}
+
+
+ivec3 world_to_grid_indices(vec3 world_position, int volume) {
+  const ivec3 counts = probe_volumes[volume].counts.xyz;
+  return clamp(ivec3((world_position - probe_volumes[volume].origin.xyz) / get_volume_spacing(volume)), ivec3(0), counts - ivec3(1));
+}
+
+// Share of a volume in the irradiance of a point: 1 inside, fading to 0 over the outer cell of its probes
+const float VOLUME_BLEND_CELLS = 1.0f;
 
-ivec3 world_to_grid_indices(vec3 world_position) {
-  return clamp(ivec3((world_position - probe_grid_position) * reciprocal_probe_spacing), ivec3(0), probe_counts - ivec3(1));
+float get_volume_blend_weight(vec3 world_position, int volume) {
+  const vec3 grid_position = (world_position - probe_volumes[volume].origin.xyz) / get_volume_spacing(volume);
+  const vec3 edge_distance = min(grid_position, vec3(probe_volumes[volume].counts.xyz - ivec3(1)) - grid_position);
+  return clamp(min(min(edge_distance.x, edge_distance.y), edge_distance.z) / VOLUME_BLEND_CELLS, 0.0f, 1.0f);
 }
 
 
-int get_probe_index_from_pixels(ivec2 pixels, int probe_with_border_side, int full_texture_width) {
-  int probes_per_side = full_texture_width / probe_with_border_side;
-  return int(pixels.x / probe_with_border_side) + probes_per_side * int(pixels.y / probe_with_border_side);
+
+// Scheduling
+//--------------------------------------------------------------------------------
+// Up to probe_update_count probes are updated per frame, picked by priority.
+// A probe left out for probe_age_horizon frames is forced in.
+
+const float PRIORITY_VISIBLE_WEIGHT  = 0.4f;
+const float PRIORITY_DISTANCE_WEIGHT = 0.25f;
+const float PRIORITY_CHANGE_WEIGHT   = 0.2f;
+const float PRIORITY_AGE_WEIGHT      = 0.15f;
+const float PRIORITY_CHANGE_SCALE    = 8.0f;  // Irradiance change that counts as fully changing
+
+float get_probe_priority(vec3 probe_position, float cell_size, mat4 view_projection, vec3 camera_position, uint age, float irradiance_change) {
+  if(age >= uint(probe_age_horizon)) {
+    return 1.0f;
+  }
+
+  // Frustum test with a guard band of a cell, probes just outside still light what is visible
+  const vec4  clip      = view_projection * vec4(probe_position, 1.0f);
+  const bool  visible   = clip.w > -cell_size && all(lessThanEqual(abs(clip.xy), vec2(clip.w + cell_size)));
+
+  const float distance_term = 1.0f / (1.0f + length(probe_position - camera_position) / (4.0f * cell_size));
+  const float change_term   = clamp(irradiance_change * PRIORITY_CHANGE_SCALE, 0.0f, 1.0f);
+  const float age_term      = clamp(float(age) / float(probe_age_horizon), 0.0f, 1.0f);
+
+  return PRIORITY_VISIBLE_WEIGHT * (visible ? 1.0f : 0.0f) + PRIORITY_DISTANCE_WEIGHT * distance_term
+         + PRIORITY_CHANGE_WEIGHT * change_term + PRIORITY_AGE_WEIGHT * age_term;
+}
+
+
+
+// Ray counts
+//--------------------------------------------------------------------------------
+// Each probe traces between probe_min_rays and the most rays of its volume, scaled by the relative deviation of its
+// ray luminance. Dim and converged probes stay at the minimum.
+
+const float RAYS_DIM_LUMINANCE    = 0.01f;   // Mean ray luminance under which the noise can't be seen
+const float RAYS_CONVERGED_CHANGE = 0.002f;  // Irradiance change under which the probe counts as converged
+const float RAYS_NOISY_DEVIATION  = 2.0f;    // Relative deviation that gets every ray
+
+float get_luminance(vec3 color) {
+  return dot(color, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+uint get_probe_ray_count(float luminance_mean, float luminance_variance, float irradiance_change, int max_rays) {
+  const int min_rays = min(probe_min_rays, max_rays);
+  if(luminance_mean < RAYS_DIM_LUMINANCE || irradiance_change < RAYS_CONVERGED_CHANGE) {
+    return uint(min_rays);
+  }
+
+  const float relative_deviation = sqrt(luminance_variance) / luminance_mean;
+  const float noise              = clamp(relative_deviation / RAYS_NOISY_DEVIATION, 0.0f, 1.0f);
+  const uint  rays               = uint(mix(float(min_rays), float(max_rays), noise));
+  return clamp(((rays + PROBE_RAY_GRANULARITY - 1) / PROBE_RAY_GRANULARITY) * PROBE_RAY_GRANULARITY, uint(min_rays), uint(max_rays));
+}
+
+// Start of the directions of a ray count in the ray direction table
+int get_ray_table_offset(int ray_count) {
+  const int k = ray_count / PROBE_RAY_GRANULARITY;
+  return PROBE_RAY_GRANULARITY * k * (k - 1) / 2;
+}
+
+
+
+// Spherical harmonics irradiance
+//--------------------------------------------------------------------------------
+// L1 basis ordered (Y00, Y1-1, Y10, Y11). The SH pass stores irradiance / PI per coefficient, already convolved with the
+// cosine lobe, so evaluating in the normal direction gives the same quantity as a texel of the octahedral atlas.
+vec4 get_sh_basis(vec3 direction) {
+  return vec4(0.282095f, 0.488603f * direction.y, 0.488603f * direction.z, 0.488603f * direction.x);
+}
+
+vec3 evaluate_probe_sh(int probe_index, vec3 normal) {
+  const vec4 basis  = get_sh_basis(normal);
+  vec3       result = vec3(0.0f);
+  for(int i = 0; i < PROBE_SH_COEFFICIENTS; ++i) {
+    result += imageLoad(global_images_2d[nonuniformEXT(probe_sh_index)], ivec2(i, probe_index)).rgb * basis[i];
+  }
+  // L1 rings below zero opposite a strong light
+  return max(result, vec3(0.0f));
 }
 
 
 
 // Sample Irradiance
 //--------------------------------------------------------------------------------
-vec3 sample_irradiance(vec3 world_position, vec3 normal, vec3 camera_position) {
+// A point is lit by the cage of 8 probes around the grid cell it falls in. The cage only depends on the cell, so the
+// sampling pass can load it once for a whole tile of pixels sharing it, see sampleIrradiance.glsl.
+
+// Final scale of the blended probe irradiance
+const float SAMPLE_IRRADIANCE_SCALE = 0.5f * PI * 0.95f;
 
+// Point the probes are sampled at, offset along the normal and toward the viewer to reduce shadow leaking
+vec3 get_biased_world_position(vec3 world_position, vec3 normal, vec3 camera_position) {
   const vec3 Wo = normalize(camera_position.xyz - world_position);
   // Bias vector to offset probe sampling based on normal and view vector.
   const float minimum_distance_between_probes = 1.0f;
   vec3        bias_vector = (normal * 0.2f + Wo * 0.8f) * (0.75f * minimum_distance_between_probes) * self_shadow_bias;
 
-  vec3 biased_world_position = world_position + bias_vector;
+  return world_position + bias_vector;
+}
 
-  // Sample at world position + probe offset reduces shadow leaking.
-  ivec3 base_grid_indices         = world_to_grid_indices(biased_world_position);
-  vec3  base_probe_world_position = grid_indices_to_world_no_offsets(base_grid_indices);
+// Grid indices of the cell a point falls in, alpha is how far across the cell it is, on [0, 1] for each axis
+ivec3 get_cage_base(vec3 biased_world_position, int volume, out vec3 alpha) {
+  ivec3 base_grid_indices         = world_to_grid_indices(biased_world_position, volume);
+  vec3  base_probe_world_position = grid_indices_to_world_no_offsets(base_grid_indices, volume);
 
-  // alpha is how far from the floor(currentVertex) position. on [0, 1] for each axis.
-  vec3 alpha = clamp((biased_world_position - base_probe_world_position), vec3(0.0f), vec3(1.0f));
+  alpha = clamp((biased_world_position - base_probe_world_position) / get_volume_spacing(volume), vec3(0.0f), vec3(1.0f));
+  return base_grid_indices;
+}
 
-  vec3  sum_irradiance = vec3(0.0f);
-  float sum_weight     = 0.0f;
+// Probe i of the cage of a cell, clamped to the probe grid boundary: its offset position, atlas tile and index
+void get_cage_probe(ivec3 base_grid_indices, int i, int volume, out vec3 probe_pos, out ivec3 probe_tile, out int probe_index) {
+  // Offset = 0 or 1 along each axis
+  ivec3 offset           = ivec3(i, i >> 1, i >> 2) & ivec3(1);
+  ivec3 probe_grid_coord = clamp(base_grid_indices + offset, ivec3(0), probe_volumes[volume].counts.xyz - ivec3(1));
+  ivec3 probe_storage    = grid_to_storage_indices(probe_grid_coord, volume);
 
-  // Iterate over adjacent probe cage
-  for(int i = 0; i < 8; ++i) {
-    // Compute the offset grid coord and clamp to the probe grid boundary
-    // Offset = 0 or 1 along each axis
-    ivec3 offset           = ivec3(i, i >> 1, i >> 2) & ivec3(1);
-    ivec3 probe_grid_coord = clamp(base_grid_indices + offset, ivec3(0), probe_counts - ivec3(1));
-    int   probe_index      = probe_indices_to_index(probe_grid_coord);
-
-    // Make cosine falloff in tangent plane with respect to the angle from the surface to the probe so that we never
-    // test a probe that is *behind* the surface.
-    // It doesn't have to be cosine, but that is efficient to compute and we must clip to the tangent plane.
-    vec3 probe_pos = grid_indices_to_world(probe_grid_coord, probe_index);
-
-    // Compute the trilinear weights based on the grid cell vertex to smoothly
-    // transition between probes. Avoid ever going entirely to zero because that
-    // will cause problems at the border probes. This isn't really a lerp.
-    // We're using 1-a when offset = 0 and a when offset = 1.
-    vec3  trilinear = mix(1.0 - alpha, alpha, offset);
-    float weight    = 1.0;
-
-    if(use_wrap_shading()) {
-      // Computed without the biasing applied to the "dir" variable.
-      // This test can cause reflection-map looking errors in the image
-      // (stuff looks shiny) if the transition is poor.
-      vec3 direction_to_probe = normalize(probe_pos - world_position);
-
-      // The naive soft backface weight would ignore a probe when
-      // it is behind the surface. That's good for walls. But for small details inside of a
-      // room, the normals on the details might rule out all of the probes that have mutual
-      // visibility to the point. So, we instead use "wrap shading"
-
-      // The small offset at the end reduces the "going to zero" impact
-      // where this is really close to exactly opposite
-      const float dir_dot_n = (dot(direction_to_probe, normal) + 1.0) * 0.5f;
-      weight *= (dir_dot_n * dir_dot_n) + 0.2;
-    }
+  probe_index = probe_indices_to_index(probe_storage, volume);
+  probe_tile  = get_probe_atlas_tile(probe_storage, volume);
+  probe_pos   = grid_indices_to_world(probe_grid_coord, volume);
+}
 
-    // Bias the position at which visibility is computed; this avoids performing a shadow
-    // test *at* a surface, which is a dangerous location because that is exactly the line
-    // between shadowed and unshadowed. If the normal bias is too small, there will be
-    // light and dark leaks. If it is too large, then samples can pass through thin occluders to
-    // the other side (this can only happen if there are MULTIPLE occluders near each other, a wall surface
-    // won't pass through itself.)
-    vec3  probe_to_biased_point_direction = biased_world_position - probe_pos;
-    float distance_to_biased_point        = length(probe_to_biased_point_direction);
-    probe_to_biased_point_direction *= 1.0 / distance_to_biased_point;
+// Weighted irradiance of cage probe i in rgb, still perceptually encoded, and its weight in a
+vec4 weigh_cage_probe(int i, vec3 alpha, vec3 probe_pos, ivec3 probe_tile, int probe_index, vec3 world_position, vec3 biased_world_position, vec3 normal) {
+  ivec3 offset = ivec3(i, i >> 1, i >> 2) & ivec3(1);
+
+  // Compute the trilinear weights based on the grid cell vertex to smoothly
+  // transition between probes. Avoid ever going entirely to zero because that
+  // will cause problems at the border probes. This isn't really a lerp.
+  // We're using 1-a when offset = 0 and a when offset = 1.
+  vec3  trilinear = mix(1.0 - alpha, alpha, offset);
+  float weight    = 1.0;
+
+  // Make cosine falloff in tangent plane with respect to the angle from the surface to the probe so that we never
+  // test a probe that is *behind* the surface.
+  // It doesn't have to be cosine, but that is efficient to compute and we must clip to the tangent plane.
+  if(use_wrap_shading()) {
+    // Computed without the biasing applied to the "dir" variable.
+    // This test can cause reflection-map looking errors in the image
+    // (stuff looks shiny) if the transition is poor.
+    vec3 direction_to_probe = normalize(probe_pos - world_position);
+
+    // The naive soft backface weight would ignore a probe when
+    // it is behind the surface. That's good for walls. But for small details inside of a
+    // room, the normals on the details might rule out all of the probes that have mutual
+    // visibility to the point. So, we instead use "wrap shading"
+
+    // The small offset at the end reduces the "going to zero" impact
+    // where this is really close to exactly opposite
+    const float dir_dot_n = (dot(direction_to_probe, normal) + 1.0) * 0.5f;
+    weight *= (dir_dot_n * dir_dot_n) + 0.2;
+  }
 
-    // Visibility
-    if(use_visibility()) {
+  // Bias the position at which visibility is computed; this avoids performing a shadow
+  // test *at* a surface, which is a dangerous location because that is exactly the line
+  // between shadowed and unshadowed. If the normal bias is too small, there will be
+  // light and dark leaks. If it is too large, then samples can pass through thin occluders to
+  // the other side (this can only happen if there are MULTIPLE occluders near each other, a wall surface
+  // won't pass through itself.)
+  vec3  probe_to_biased_point_direction = biased_world_position - probe_pos;
+  float distance_to_biased_point        = length(probe_to_biased_point_direction);
+  probe_to_biased_point_direction *= 1.0 / distance_to_biased_point;
 
-      vec2 uv = get_probe_uv(probe_to_biased_point_direction, probe_index, visibility_texture_width, visibility_texture_height, visibility_side_length);
-      vec2 visibility = textureLod(global_textures[nonuniformEXT(grid_visibility_texture_index)], uv, 0).rg;
+  // Visibility
+  if(use_visibility()) {
 
-      float mean_distance_to_occluder = visibility.x;
+    vec3 uv = get_probe_uv(probe_to_biased_point_direction, probe_tile, visibility_texture_width, visibility_texture_height, visibility_side_length);
+    vec2 visibility = textureLod(probe_textures[PROBE_VISIBILITY_TEXTURE], uv, 0).rg;
 
-      float chebyshev_weight = 1.0;
-      if(distance_to_biased_point > mean_distance_to_occluder) {
-        // In "shadow"
-        float variance = abs((visibility.x * visibility.x) - visibility.y);
+    float mean_distance_to_occluder = visibility.x;
 
-        // Need the max in the denominator because biasing can cause a negative displacement
-        const float distance_diff = distance_to_biased_point - mean_distance_to_occluder;
+    float chebyshev_weight = 1.0;
+    if(distance_to_biased_point > mean_distance_to_occluder) {
+      // In "shadow"
+      float variance = abs((visibility.x * visibility.x) - visibility.y);
 
-        chebyshev_weight          = variance / (variance + (distance_diff * distance_diff));
+      // Need the max in the denominator because biasing can cause a negative displacement
+      const float distance_diff = distance_to_biased_point - mean_distance_to_occluder;
 
-        // Increase contrast in the weight
-        chebyshev_weight = max((chebyshev_weight * chebyshev_weight * chebyshev_weight), 0.0f);
-      }
+      chebyshev_weight          = variance / (variance + (distance_diff * distance_diff));
 
-      // Avoid visibility weights ever going all of the way to zero because when *no* probe has
-      // visibility we need some fallback value.
-      chebyshev_weight = max(0.6f, chebyshev_weight);
-      weight *= chebyshev_weight;
+      // Increase contrast in the weight
+      chebyshev_weight = max((chebyshev_weight * chebyshev_weight * chebyshev_weight), 0.0f);
     }
 
-    // Avoid zero weight
-    weight = max(0.000001, weight);
+    // Avoid visibility weights ever going all of the way to zero because when *no* probe has
+    // visibility we need some fallback value.
+    chebyshev_weight = max(0.6f, chebyshev_weight);
+    weight *= chebyshev_weight;
+  }
 
-    // A small amount of light is visible due to logarithmic perception, so
-    // crush tiny weights but keep the curve continuous
-    const float crushThreshold = 0.2f;
-    if(weight < crushThreshold) {
-        weight *= (weight * weight) * (1.f / (crushThreshold * crushThreshold));
-    }
+  // Avoid zero weight
+  weight = max(0.000001, weight);
 
-    vec2 uv = get_probe_uv(normal, probe_index, irradiance_texture_width, irradiance_texture_height, irradiance_side_length);
+  // A small amount of light is visible due to logarithmic perception, so
+  // crush tiny weights but keep the curve continuous
+  const float crushThreshold = 0.2f;
+  if(weight < crushThreshold) {
+      weight *= (weight * weight) * (1.f / (crushThreshold * crushThreshold));
+  }
 
-    vec3 probe_irradiance = textureLod(global_textures[nonuniformEXT(grid_irradiance_output_index)], uv, 0).rgb;
+  vec3 probe_irradiance;
+  if(use_sh_irradiance()) {
+    probe_irradiance = evaluate_probe_sh(probe_index, normal);
+  }
+  else {
+    vec3 uv = get_probe_uv(normal, probe_tile, irradiance_texture_width, irradiance_texture_height, irradiance_side_length);
+
+    probe_irradiance = textureLod(probe_textures[PROBE_IRRADIANCE_TEXTURE], uv, 0).rgb;
 
     if(use_perceptual_encoding()) {
         probe_irradiance = pow(probe_irradiance, vec3(0.5f * 5.0f));
     }
+  }
 
-    // Trilinear weights
-    weight *= trilinear.x * trilinear.y * trilinear.z + 0.00001f;
+  // Trilinear weights
+  weight *= trilinear.x * trilinear.y * trilinear.z + 0.00001f;
 
-    sum_irradiance += weight * probe_irradiance;
-    sum_weight += weight;
-  }
+  return vec4(weight * probe_irradiance, weight);
+}
 
-  vec3 net_irradiance = sum_irradiance / sum_weight;
+// Blended irradiance of a cage out of the summed weighted probes
+vec3 resolve_cage_irradiance(vec4 sum) {
+  vec3 net_irradiance = sum.rgb / sum.a;
 
-  if(use_perceptual_encoding()) {
+  // SH coefficients are blended linearly, the perceptual encoding only applies to the atlas
+  if(use_perceptual_encoding() && !use_sh_irradiance()) {
     net_irradiance = net_irradiance * net_irradiance;
   }
 
-  vec3 irradiance = 0.5f * PI * net_irradiance * 0.95f;
+  return net_irradiance;
+}
+
+// Irradiance of the probe cage of one volume around a point, out of the perceptual encoding
+vec3 sample_volume_irradiance(int volume, vec3 world_position, vec3 biased_world_position, vec3 normal) {
+
+  // Sample at world position + probe offset reduces shadow leaking.
+  vec3  alpha;
+  ivec3 base_grid_indices = get_cage_base(biased_world_position, volume, alpha);
+
+  // Iterate over adjacent probe cage
+  vec4 sum = vec4(0.0f);
+  for(int i = 0; i < 8; ++i) {
+    vec3  probe_pos;
+    ivec3 probe_tile;
+    int   probe_index;
+    get_cage_probe(base_grid_indices, i, volume, probe_pos, probe_tile, probe_index);
+    sum += weigh_cage_probe(i, alpha, probe_pos, probe_tile, probe_index, world_position, biased_world_position, normal);
+  }
+
+  return resolve_cage_irradiance(sum);
+}
+
+// The only volume sampled at a point, -1 when it lies where two volumes blend
+int get_single_volume(vec3 biased_world_position) {
+  for(int volume = 0; volume < probe_volume_count - 1; ++volume) {
+    const float weight = get_volume_blend_weight(biased_world_position, volume);
+    if(weight > 0.0f) {
+      return weight >= 1.0f ? volume : -1;
+    }
+  }
+  return probe_volume_count - 1;
+}
+
+
+vec3 sample_irradiance(vec3 world_position, vec3 normal, vec3 camera_position) {
+
+  vec3 biased_world_position = get_biased_world_position(world_position, normal, camera_position);
+
+  // Volumes earlier in the list take precedence, each fading out over its outer cell so overlapping volumes blend.
+  // The last one takes whatever weight is left, clamped to its border like a single grid.
+  vec3  net_irradiance   = vec3(0.0f);
+  float remaining_weight = 1.0f;
+  for(int volume = 0; volume < probe_volume_count && remaining_weight > 0.0f; ++volume) {
+    const float weight = (volume == probe_volume_count - 1) ? 1.0f : get_volume_blend_weight(biased_world_position, volume);
+    if(weight > 0.0f) {
+      net_irradiance += remaining_weight * weight * sample_volume_irradiance(volume, world_position, biased_world_position, normal);
+      remaining_weight *= 1.0f - weight;
+    }
+  }
 
-  return irradiance;
+  return SAMPLE_IRRADIANCE_SCALE * net_irradiance;
 }
 
 
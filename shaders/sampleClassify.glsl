@@ -0,0 +1,91 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+
+#include "host_device.h"
+#include "probeUtil.glsl"
+#include "sampleUtil.glsl"
+
+
+layout(push_constant) uniform _PushConstantSample {
+  PushConstantSample pcSample;
+};
+
+layout(set = 1, binding = eGlobals) uniform _GlobalUniforms{ GlobalUniforms uni; };
+
+
+layout(local_size_x = SAMPLE_TILE_SIZE, local_size_y = SAMPLE_TILE_SIZE, local_size_z = 1) in;
+
+
+// Cell key of a surface: volume in the top bits, cell index below, CELL_MIXED where two volumes blend
+const uint CELL_NONE  = 0xFFFFFFFFu;
+const uint CELL_MIXED = 0xFFFFFFFEu;
+
+shared uint tile_cell_min;
+shared uint tile_cell_max;
+
+
+// One workgroup per tile of the sampling dispatch. Picks the same pixel of every block the sampling will, and files the
+// tile under sky (stored right here), coherent (one cell of one volume, the cage is loaded once) or mixed.
+void main() {
+  const int  resolution_divider = int(pcSample.resolution_divider);
+  const vec3 camera_position    = uni.position;
+
+  if(gl_LocalInvocationIndex == 0) {
+    tile_cell_min = CELL_NONE;
+    tile_cell_max = 0;
+  }
+  barrier();
+
+  const ivec2 coords      = ivec2(gl_GlobalInvocationID.xy);
+  const ivec2 output_size = (ivec2(resolution) + resolution_divider - 1) / resolution_divider;
+  const bool  inside      = all(lessThan(coords, output_size));
+
+  float raw_depth    = 1.0;
+  int   sample_index = inside ? select_block_sample(coords, resolution_divider, pcSample.sample_rotation, raw_depth) : -1;
+  if(sample_index != -1) {
+    const ivec2 chosen_pixel   = get_sample_pixel(coords, resolution_divider, sample_index);
+    vec2        encoded_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], chosen_pixel, 0).rg;
+    vec3        normal         = normalize(oct_decode(encoded_normal));
+
+    const vec3 world_position        = get_world_position(uv_nearest(chosen_pixel, resolution), raw_depth, uni.projection, uni.viewInverse);
+    const vec3 biased_world_position = get_biased_world_position(world_position, normal, camera_position);
+    const int  volume                = get_single_volume(biased_world_position);
+
+    uint cell = CELL_MIXED;
+    if(volume >= 0) {
+      vec3        alpha;
+      const ivec3 base   = get_cage_base(biased_world_position, volume, alpha);
+      const ivec3 counts = probe_volumes[volume].counts.xyz;
+      cell               = (uint(volume) << 28) | uint(base.x + counts.x * (base.y + counts.y * base.z));
+    }
+    atomicMin(tile_cell_min, cell);
+    atomicMax(tile_cell_max, cell);
+  }
+  barrier();
+
+  const uint cell_min = tile_cell_min;
+  const uint cell_max = tile_cell_max;
+  if(cell_min == CELL_NONE) {
+    // Nothing but sky, no sampling dispatch covers the tile
+    if(inside) {
+      store_sky_sample(coords, resolution_divider);
+    }
+    if(gl_LocalInvocationIndex == 0) {
+      atomicAdd(tile_args.sky_count, 1);
+    }
+    return;
+  }
+
+  if(gl_LocalInvocationIndex == 0) {
+    const uint packed_tile = pack_sample_tile(gl_WorkGroupID.xy);
+    if(cell_min == cell_max && cell_max != CELL_MIXED) {
+      sample_tiles[atomicAdd(tile_args.coherent_x, 1)] = packed_tile;
+    }
+    else {
+      sample_tiles[tile_args.sample_tile_capacity + atomicAdd(tile_args.mixed_x, 1)] = packed_tile;
+    }
+  }
+}
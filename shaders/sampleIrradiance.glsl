@@ -6,6 +6,7 @@
 
 #include "host_device.h"
 #include "probeUtil.glsl"
+#include "sampleUtil.glsl"
 
 
 layout(std430, set = 0, binding = eStatus) readonly buffer ProbeStatusSSBO {
@@ -19,95 +20,90 @@ layout(push_constant) uniform _PushConstantSample {
 layout(set = 1, binding = eGlobals) uniform _GlobalUniforms{ GlobalUniforms uni; };
 
 
-ivec2 pixel_offsets[] = ivec2[](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
-
-layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
-
-
-
-vec3 get_world_position(vec2 screen_uv, float depth, mat4 projectionMatrix, mat4 inverseView) {
-  // Convert screen UV coordinates to NDC (Normalized Device Coordinates)
-  vec2 ndc = screen_uv * 2.0 - 1.0;
-
-  // Convert depth from [0, 1] to [-1, 1] (clip space depth)
-  float clip_depth = depth * 2.0 - 1.0;
-
-  // Create the clip space position vector
-  vec4 clipSpacePosition = vec4(ndc, clip_depth, 1.0);
-
-  // Convert from clip space to view space (using inverse of the projection matrix)
-  vec4 viewSpacePosition = inverse(projectionMatrix) * clipSpacePosition;
-
-  // Perform perspective division to get view space position
-  viewSpacePosition /= viewSpacePosition.w;
-
-  // Convert from view space to world space (using inverse of the view matrix)
-  vec4 worldSpacePosition = inverseView * viewSpacePosition;
-
-  return worldSpacePosition.xyz;
-}
+layout(local_size_x = SAMPLE_TILE_SIZE, local_size_y = SAMPLE_TILE_SIZE, local_size_z = 1) in;
 
 
+#if defined(SAMPLE_COHERENT)
+// Every surface of a coherent tile samples the same cage, loaded once by the first 8 threads
+shared int   tile_volume;
+shared ivec3 tile_base_grid_indices;
+shared vec3  cage_probe_position[8];
+shared ivec3 cage_probe_tile[8];
+shared int   cage_probe_index[8];
+#endif
 
 
+// One thread per pixel of the reduced resolution, resolution_divider x resolution_divider full resolution pixels.
+// At full resolution the result goes straight to the indirect image. Otherwise every texel of the low resolution image
+// keeps, in alpha, which pixel of its block it was sampled at, the upsample pass weighs it by that pixel's depth and normal.
+// While accumulating temporally the sampled pixel rotates through the block, so the history covers all of them.
+// Built twice: the mixed variant samples every volume per pixel, SAMPLE_COHERENT the tiles the classification found
+// inside a single cell of a single volume. Classified sky tiles never get here.
 void main() {
-  uint output_resolution_half   = pcSample.output_resolution_half;
-  vec3 camera_position          = uni.position;
-
-
-  ivec3 coords                  = ivec3(gl_GlobalInvocationID.xyz);
+  const int  resolution_divider = int(pcSample.resolution_divider);
+  const vec3 camera_position    = uni.position;
+
+#if defined(SAMPLE_COHERENT)
+  const ivec2 tile = unpack_sample_tile(sample_tiles[gl_WorkGroupID.x]);
+#else
+  const ivec2 tile = pcSample.tile_list != 0 ? unpack_sample_tile(sample_tiles[tile_args.sample_tile_capacity + gl_WorkGroupID.x]) :
+                                               ivec2(gl_WorkGroupID.xy);
+#endif
+  const ivec2 coords = tile * SAMPLE_TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+
+  const ivec2 output_size  = (ivec2(resolution) + resolution_divider - 1) / resolution_divider;
+  const uint  output_index = resolution_divider == 1 ? indirect_output_index : indirect_low_res_index;
+  const bool  inside       = all(lessThan(coords, output_size));
+
+  float raw_depth    = 1.0;
+  int   sample_index = inside ? select_block_sample(coords, resolution_divider, pcSample.sample_rotation, raw_depth) : -1;
+  if(inside && sample_index == -1) {
+    store_sky_sample(coords, resolution_divider);
+  }
 
-  int  resolution_divider = output_resolution_half == 1 ? 2 : 1;
+  const ivec2 chosen_pixel = get_sample_pixel(coords, resolution_divider, max(sample_index, 0));
 
-  vec2 screen_uv          = uv_nearest(coords.xy, resolution / resolution_divider);
+  vec2 encoded_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], chosen_pixel, 0).rg;
+  vec3 normal         = normalize(oct_decode(encoded_normal));
 
-  float raw_depth                        = 1.0;
-  int   chosen_hiresolution_sample_index = 0;
-  if(output_resolution_half == 1) {
-    float closer_depth = 0.0;
-    for(int i = 0; i < 4; ++i) {
+  vec2 screen_uv = uv_nearest(chosen_pixel, resolution);
 
-      float depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], (coords.xy) * 2 + pixel_offsets[i], 0).r;
+  const vec3 pixel_world_position = get_world_position(screen_uv, raw_depth, uni.projection, uni.viewInverse);
 
-      if(closer_depth < depth) {
-        closer_depth                     = depth;
-        chosen_hiresolution_sample_index = i;
-      }
-    }
+#if defined(SAMPLE_COHERENT)
+  // The cage comes from any surface of the tile, they all agree. Barriers stay in uniform control flow.
+  const vec3 biased_world_position = get_biased_world_position(pixel_world_position, normal, camera_position);
+  vec3       alpha                 = vec3(0.0f);
+  if(sample_index != -1) {
+    const int volume       = get_single_volume(biased_world_position);
+    tile_volume            = volume;
+    tile_base_grid_indices = get_cage_base(biased_world_position, volume, alpha);
+  }
+  barrier();
 
-    raw_depth = closer_depth;
-  } else {
-    raw_depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], coords.xy, 0).r;
+  if(gl_LocalInvocationIndex < 8) {
+    const int i = int(gl_LocalInvocationIndex);
+    get_cage_probe(tile_base_grid_indices, i, tile_volume, cage_probe_position[i], cage_probe_tile[i], cage_probe_index[i]);
   }
-  
-  if(raw_depth == 1.0) {
-    imageStore(global_images_2d[indirect_output_index], coords.xy, vec4(0, 0, 0, 1));
+  barrier();
+
+  if(sample_index == -1) {
     return;
   }
 
-  // Manually fetch normals when in low resolution
-  vec3 normal = vec3(0);
-
-  if(output_resolution_half == 1) {
-    vec2 encoded_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], (coords.xy) * 2 + pixel_offsets[chosen_hiresolution_sample_index], 0).rg;
-    normal = normalize(oct_decode(encoded_normal));
-
-    //vec3 texture_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], (coords.xy) * 2 + pixel_offsets[chosen_hiresolution_sample_index], 0).rgb;
-    //normal = normalize(texture_normal);
+  vec4 sum = vec4(0.0f);
+  for(int i = 0; i < 8; ++i) {
+    sum += weigh_cage_probe(i, alpha, cage_probe_position[i], cage_probe_tile[i], cage_probe_index[i], pixel_world_position,
+                            biased_world_position, normal);
   }
-  else {
-    vec2 encoded_normal = texelFetch(global_textures[nonuniformEXT(normal_texture_index)], coords.xy, 0).rg;
-    normal              = oct_decode(encoded_normal);
-
+  vec3 irradiance = SAMPLE_IRRADIANCE_SCALE * resolve_cage_irradiance(sum);
+#else
+  if(sample_index == -1) {
+    return;
   }
 
-  
-  
-
-
-  const vec3 pixel_world_position = get_world_position(screen_uv, raw_depth, uni.projection, uni.viewInverse);
-  
   vec3 irradiance = sample_irradiance(pixel_world_position, normal, camera_position);
-  imageStore(global_images_2d[indirect_output_index], coords.xy, vec4(irradiance, 1.0));
+#endif
 
+  imageStore(global_images_2d[output_index], coords, vec4(irradiance, resolution_divider == 1 ? 1.0 : float(sample_index)));
 }
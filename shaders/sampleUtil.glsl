@@ -0,0 +1,86 @@
+// Shared by the classification and sampling dispatches of the irradiance sampling pass.
+// Include after probeUtil.glsl.
+
+layout(std430, set = 0, binding = eSampleTiles) buffer SampleTilesSSBO {
+  SampleTileArgs tile_args;
+  uint           sample_tiles[];  // Tile x | y << 16, coherent list first, mixed list from sample_tile_capacity on
+};
+
+
+vec3 get_world_position(vec2 screen_uv, float depth, mat4 projectionMatrix, mat4 inverseView) {
+  // Convert screen UV coordinates to NDC (Normalized Device Coordinates)
+  vec2 ndc = screen_uv * 2.0 - 1.0;
+
+  // Hardware depth of a zero-to-one projection is already the clip space depth
+  float clip_depth = depth;
+
+  // Create the clip space position vector
+  vec4 clipSpacePosition = vec4(ndc, clip_depth, 1.0);
+
+  // Convert from clip space to view space (using inverse of the projection matrix)
+  vec4 viewSpacePosition = inverse(projectionMatrix) * clipSpacePosition;
+
+  // Perform perspective division to get view space position
+  viewSpacePosition /= viewSpacePosition.w;
+
+  // Convert from view space to world space (using inverse of the view matrix)
+  vec4 worldSpacePosition = inverseView * viewSpacePosition;
+
+  return worldSpacePosition.xyz;
+}
+
+
+// Pixel of the block of a reduced resolution pixel that gets sampled, as its index inside the block, -1 when the whole
+// block is sky. The pixel of this frame's rotation, otherwise the farthest surface of the block.
+int select_block_sample(ivec2 coords, int resolution_divider, int sample_rotation, out float raw_depth) {
+  const ivec2 full_size = ivec2(resolution);
+
+  int   chosen_hiresolution_sample_index = -1;
+  float farthest_depth                   = 0.0;
+  if(sample_rotation >= 0) {
+    const ivec2 pixel = coords * resolution_divider + ivec2(sample_rotation % resolution_divider, sample_rotation / resolution_divider);
+    if(all(lessThan(pixel, full_size))) {
+      float depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], pixel, 0).r;
+      if(depth < 1.0) {
+        farthest_depth                   = depth;
+        chosen_hiresolution_sample_index = sample_rotation;
+      }
+    }
+  }
+
+  const int block_samples = chosen_hiresolution_sample_index == -1 ? resolution_divider * resolution_divider : 0;
+  for(int i = 0; i < block_samples; ++i) {
+    const ivec2 pixel = coords * resolution_divider + ivec2(i % resolution_divider, i / resolution_divider);
+    if(any(greaterThanEqual(pixel, full_size))) {
+      continue;
+    }
+
+    float depth = texelFetch(global_textures[nonuniformEXT(depth_fullscreen_texture_index)], pixel, 0).r;
+
+    if(depth < 1.0 && farthest_depth <= depth) {
+      farthest_depth                   = depth;
+      chosen_hiresolution_sample_index = i;
+    }
+  }
+
+  raw_depth = farthest_depth;
+  return chosen_hiresolution_sample_index;
+}
+
+ivec2 get_sample_pixel(ivec2 coords, int resolution_divider, int sample_index) {
+  return coords * resolution_divider + ivec2(sample_index % resolution_divider, sample_index / resolution_divider);
+}
+
+// Output of a block with nothing to sample, the upsample pass skips texels with a negative sample index
+void store_sky_sample(ivec2 coords, int resolution_divider) {
+  const uint output_index = resolution_divider == 1 ? indirect_output_index : indirect_low_res_index;
+  imageStore(global_images_2d[output_index], coords, vec4(0, 0, 0, resolution_divider == 1 ? 1.0 : -1.0));
+}
+
+uint pack_sample_tile(uvec2 tile) {
+  return tile.x | (tile.y << 16);
+}
+
+ivec2 unpack_sample_tile(uint packed_tile) {
+  return ivec2(packed_tile & 0xFFFFu, packed_tile >> 16);
+}
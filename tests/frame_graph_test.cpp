@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------------------
+// Barrier tests of the frame graph. vkCmdPipelineBarrier is stubbed below, so the graph runs without
+// a device and the barriers are checked through the per pass counts of the schedule.
+//
+#include <cstdio>
+
+#include "Frame_Graph.h"
+
+
+static uint32_t recorded_barriers = 0;
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer,
+                                                VkPipelineStageFlags,
+                                                VkPipelineStageFlags,
+                                                VkDependencyFlags,
+                                                uint32_t,
+                                                const VkMemoryBarrier*,
+                                                uint32_t bufferMemoryBarrierCount,
+                                                const VkBufferMemoryBarrier*,
+                                                uint32_t imageMemoryBarrierCount,
+                                                const VkImageMemoryBarrier*) {
+  recorded_barriers += bufferMemoryBarrierCount + imageMemoryBarrierCount;
+}
+
+
+static int failures = 0;
+
+static void expect_barriers(const Frame_Graph& graph, const std::vector<uint32_t>& expected, const char* test) {
+  const std::vector<Frame_Graph::Pass_Info>& schedule = graph.get_schedule();
+  for(size_t i = 0; i < expected.size(); ++i) {
+    if(i >= schedule.size() || schedule[i].culled || schedule[i].barrier_count != expected[i]) {
+      std::printf("FAILED %s: pass %zu expected %u barriers, got %u\n", test, i, expected[i],
+                  i < schedule.size() ? schedule[i].barrier_count : 0u);
+      ++failures;
+    }
+  }
+}
+
+static void noop(VkCommandBuffer) {}
+
+
+//--------------------------------------------------------------------------------------------------
+// Write, then read-modify-write, then read, all in the compute stage: the read has to wait on the
+// read-modify-write even though the resource was last read in that stage
+//
+static void test_read_after_read_modify_write() {
+  Frame_Graph graph;
+  VkBuffer    handle = reinterpret_cast<VkBuffer>(uintptr_t(1));
+
+  const VkPipelineStageFlags compute = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  const VkAccessFlags        read    = VK_ACCESS_SHADER_READ_BIT;
+  const VkAccessFlags        write   = VK_ACCESS_SHADER_WRITE_BIT;
+
+  graph.begin_frame();
+  uint32_t buffer = graph.import_buffer("Buffer", handle);
+  graph.add_pass("Write", {}, {{buffer, compute, write}}, noop);
+  graph.add_pass("Read Modify Write", {{buffer, compute, read}}, {{buffer, compute, write}}, noop);
+  graph.add_pass("Read", {{buffer, compute, read}}, {}, noop, true);
+  graph.add_pass("Read Again", {{buffer, compute, read}}, {}, noop, true);
+  graph.execute(VK_NULL_HANDLE);
+  expect_barriers(graph, {0, 1, 1, 0}, "read after read-modify-write");
+
+  // Next frame: the state carries over, the first read is covered, a write then needs a barrier again
+  graph.begin_frame();
+  buffer = graph.import_buffer("Buffer", handle);
+  graph.add_pass("Read", {{buffer, compute, read}}, {}, noop, true);
+  graph.add_pass("Read Modify Write", {{buffer, compute, read}}, {{buffer, compute, write}}, noop, true);
+  graph.add_pass("Read", {{buffer, compute, read}}, {}, noop, true);
+  graph.execute(VK_NULL_HANDLE);
+  expect_barriers(graph, {0, 1, 1}, "read after read-modify-write, next frame");
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// A plain write, two reads in the same stage and a write after them
+//
+static void test_read_after_write() {
+  Frame_Graph graph;
+  VkBuffer    handle = reinterpret_cast<VkBuffer>(uintptr_t(2));
+
+  const VkPipelineStageFlags compute = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+  graph.begin_frame();
+  const uint32_t buffer = graph.import_buffer("Buffer", handle);
+  graph.add_pass("Write", {}, {{buffer, compute, VK_ACCESS_SHADER_WRITE_BIT}}, noop);
+  graph.add_pass("Read", {{buffer, compute, VK_ACCESS_SHADER_READ_BIT}}, {}, noop, true);
+  graph.add_pass("Read Again", {{buffer, compute, VK_ACCESS_SHADER_READ_BIT}}, {}, noop, true);
+  graph.add_pass("Write After Read", {}, {{buffer, compute, VK_ACCESS_SHADER_WRITE_BIT}}, noop, true);
+  graph.execute(VK_NULL_HANDLE);
+  expect_barriers(graph, {0, 1, 0, 1}, "read after write");
+}
+
+
+int main() {
+  test_read_after_read_modify_write();
+  test_read_after_write();
+
+  if(recorded_barriers == 0) {
+    std::printf("FAILED: no barrier reached vkCmdPipelineBarrier\n");
+    ++failures;
+  }
+
+  if(failures == 0) {
+    std::printf("frame graph tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
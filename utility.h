@@ -75,4 +75,15 @@ namespace Util{
         glm_euler_xyz2(angles, dest);
         return dest;
     }
+
+
+    // Unit vector to the [-1, +1] octahedral square, the host side of oct_encode in probeUtil.glsl
+    glm::vec2 octEncode(glm::vec3 v) {
+        glm::vec2 result = glm::vec2(v) / (std::abs(v.x) + std::abs(v.y) + std::abs(v.z));
+        if(v.z < 0.0f) {
+            glm::vec2 sign = glm::vec2(result.x >= 0.0f ? 1.0f : -1.0f, result.y >= 0.0f ? 1.0f : -1.0f);
+            result         = (1.0f - glm::abs(glm::vec2(result.y, result.x))) * sign;
+        }
+        return result;
+    }
 };
\ No newline at end of file